@@ -0,0 +1,54 @@
+#!/bin/sh
+# End-to-end benchmark of its and rmcrag over the instances of a directory.
+# Writes CSV lines
+#   program,instance,wall_ms,peak_rss_kb,status,iterations_per_s,time_to_best_s,value
+# to stdout, after a header line.  its makes its usual ten runs with an
+# iteration limit, so that the work done does not depend on the speed of
+# the machine; iterations_per_s and time_to_best_s are averaged over the
+# runs.  rmcrag has no iterations and reports no time to best.  its is
+# run with b1=b2=m, the subset size of the instance: the number after the
+# last "m" of the file name (GKD-a_1_n10_m2.txt, m50.txt) or else the
+# second number of its first line; instances with neither are skipped.
+# Usage: bench.sh [data_dir]
+# Environment: ITERATIONS (its, default 20000), RMCRAG_K (default 5),
+# BENCH_TMP (scratch directory, default /tmp).
+# Build with optimization for meaningful numbers: make clean; make bench OPT=-O2
+
+DATA=${1:-./data}
+ITERATIONS=${ITERATIONS:-20000}
+RMCRAG_K=${RMCRAG_K:-5}
+BIN=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d "${BENCH_TMP:-/tmp}/its_bench.XXXXXX") || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+echo "program,instance,wall_ms,peak_rss_kb,status,iterations_per_s,time_to_best_s,value"
+for f in "$DATA"/*.txt; do
+	[ -f "$f" ] || continue
+	name=$(basename "$f")
+	abs=$(cd "$(dirname "$f")" && pwd)/$name
+	m=$(echo "$name" | sed -n 's/.*m\([0-9][0-9]*\)\.txt$/\1/p')
+	[ -n "$m" ] || m=$(head -n 1 "$f" | awk '{ print $2 }')
+	if [ -z "$m" ]; then
+		echo "$name: no subset size, skipped" >&2
+		continue
+	fi
+
+	rm -f "$WORK"/*
+	(cd "$WORK" && "$BIN/bench/bench_run" run.csv /dev/null "$BIN/its/its" -t 0 \
+			-i "$ITERATIONS" -j 1 -b "$m" "$abs" out.txt sum.txt)
+	m=$(cat "$WORK/run.csv")
+	rate=$(cat "$WORK"/out*.txt 2>/dev/null | awk '
+		/number of iterations  / { it += $NF }
+		/total time:/ { split($3 ":" $5 ":" $7, t, ":"); s += t[1] * 3600 + t[2] * 60 + t[3] }
+		END { if (s > 0) printf "%.0f", it / s }')
+	best=$(tail -n 2 "$WORK/sum.txt" 2>/dev/null | head -n 1 | awk '{ print $2 }')
+	value=$(tail -n 2 "$WORK/sum.txt" 2>/dev/null | head -n 1 | awk '{ print $1 }')
+	echo "its,$name,$m,$rate,$best,$value"
+
+	rm -f "$WORK"/*
+	"$BIN/bench/bench_run" "$WORK/run.csv" "$WORK/rmcrag.txt" \
+			"$BIN/rmcrag/rmcrag" -k "$RMCRAG_K" -f "$abs"
+	m=$(cat "$WORK/run.csv")
+	value=$(awk -F': ' '/Cost of solution \(SUM\)/ { print $2 }' "$WORK/rmcrag.txt")
+	echo "rmcrag,$name,$m,,,$value"
+done
@@ -0,0 +1,258 @@
+/* Microbenchmarks of the hot kernels of ITS: the gain updates, the swap
+ scan of one member, local_search from a random start and the triplet
+ loader, each at several graph orders.  For every order n a random
+ instance is written to a scratch directory and loaded, once with one
+ thread and once with one per processor.  Results go to stdout as CSV
+ lines "kernel,n,variant,value,unit", after a header line.
+ Usage: bench_kernels [-n n1,n2,...] [-d scratch_dir] [-m min_ms]
+ Each kernel is repeated, doubling the repetitions, until a measurement
+ takes at least min_ms milliseconds. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ITS.h"
+#include "kernels.h"
+
+#define BENCH_MAX_ORDERS            16
+#define BENCH_MIN_MS               200.  /* default shortest measurement     */
+#define BENCH_SEED                1000.
+
+/* internal functions of ITS.cpp */
+double *weight_row(Weights *pweight, int k, double *buf);
+void build_lists(int size, SearchState *pst);
+double compute_gains(int size, Weights *pweight, SearchState *pst);
+double random_start(int size, int b1, int b2, int *cl_size, Rng *prng,
+		Weights *pweight, SearchState *pst);
+double local_search(int size, int b1, int b2, int *cl_size, long *it_count,
+		Weights *pweight, SearchState *pst);
+int alloc_state(int size, SearchState *pst);
+void free_state(SearchState *pst);
+
+typedef struct
+     {Weights *pweight;
+      SearchState *pst;
+      int size;
+      int b;              /* subset size                                      */
+      int k, m;           /* member and non-member moved                      */
+      double *row1;       /* weight row of k                                  */
+      double *row2;       /* weight row of m                                  */
+      double *clout;      /* gains of the non-members, -INFINITY for members  */
+      int *mask;          /* tabu pair mask, all clear                        */
+      long evaluated;     /* pairs evaluated by swap_scan                     */
+      int *keep_sol;      /* random start for local_search                    */
+      long it_count;      /* evaluations of local_search                      */
+      double ls_ms;       /* time spent in local_search itself                */
+     }BenchCtx;
+
+typedef void (*bench_fn)(BenchCtx *pc);
+
+/* Runs fn, doubling the repetitions until they take min_ms; returns the
+ milliseconds per call and the repetitions in *preps. The counters of
+ the context are those of the last round. */
+static double time_calls(bench_fn fn, BenchCtx *pc, double min_ms,
+		long *preps) {
+	long reps, r;
+	double start, elapsed;
+
+	for (reps = 1;; reps *= 2) {
+		pc->evaluated = pc->it_count = 0;
+		pc->ls_ms = 0.;
+		start = clock_ms();
+		for (r = 0; r < reps; r++)
+			fn(pc);
+		elapsed = clock_ms() - start;
+		if (elapsed >= min_ms || reps >= (1L << 40))
+			break;
+	}
+	*preps = reps;
+	return elapsed / reps;
+}
+
+/* gain_add followed by gain_sub with the same row restores the gains up to
+ rounding, so the pair can be repeated indefinitely. */
+static void bench_add_sub(BenchCtx *pc) {
+	gain_add(pc->pst->cl, pc->row2, pc->size, pc->m);
+	gain_sub(pc->pst->cl, pc->row2, pc->size, pc->m);
+}
+
+static void bench_swap(BenchCtx *pc) {
+	gain_swap(pc->pst->cl, pc->row1, pc->row2, pc->size, pc->k, pc->m,
+			FUSED_GAIN_UPDATE);
+	gain_swap(pc->pst->cl, pc->row2, pc->row1, pc->size, pc->m, pc->k,
+			FUSED_GAIN_UPDATE);
+}
+
+static void bench_scan(BenchCtx *pc) {
+	double del;
+
+	swap_scan(pc->clout, pc->row1, pc->mask, pc->size,
+			*(pc->pst->cl + pc->k), &del, &pc->evaluated);
+}
+
+static void bench_local(BenchCtx *pc) {
+	SearchState *pst = pc->pst;
+	int cl_size = pc->b;
+	double start;
+
+	memcpy(pst->sol, pc->keep_sol, (pc->size + 1) * sizeof(int));
+	build_lists(pc->size, pst);
+	compute_gains(pc->size, pc->pweight, pst);
+	start = clock_ms();
+	local_search(pc->size, pc->b, pc->b, &cl_size, &pc->it_count, pc->pweight,
+			pst);
+	pc->ls_ms += clock_ms() - start;
+}
+
+/* Writes a random instance of order n in the triplet format. */
+static void write_instance(const char *file_name, int n) {
+	FILE *f;
+	Rng rng;
+	int i, j;
+
+	if ((f = fopen(file_name, "w")) == NULL) {
+		printf("  fopen failed for output  %s\n", file_name);
+		exit(1);
+	}
+	rng_seed(&rng, RNG_XOSHIRO, n);
+	fprintf(f, "%d\n", n);
+	for (i = 0; i < n; i++)
+		for (j = i + 1; j < n; j++)
+			fprintf(f, "%d %d %.2lf\n", i, j, floor(rng_next(&rng) * 100000.)
+					/ 100.);
+	fclose(f);
+}
+
+static void load_instance(const char *file_name, int threads,
+		Weights *pweight) {
+	int status;
+
+	if ((status = ITS_load(file_name, WEIGHTS_DENSE, threads, pweight))
+			!= ITS_OK) {
+		printf("  %s: %s\n", ITS_error(status), file_name);
+		exit(1);
+	}
+}
+
+/* Allocates the buffers of the context for order n; returns ITS_OK or
+ ITS_ERR_MEMORY. */
+static int alloc_ctx(BenchCtx *pc, int n) {
+	ALR(pc->keep_sol, int, n+1)
+	ALRA(pc->clout, double, n+1)
+	ALR(pc->mask, int, n+1)
+	ALRA(pc->row1, double, n+1)
+	ALRA(pc->row2, double, n+1)
+	return ITS_OK;
+}
+
+static void bench_order(FILE *out, const char *dir, int n, double min_ms) {
+	Weights weights;
+	SearchState state;
+	BenchCtx ctx;
+	Rng rng;
+	struct stat st;
+	char file_name[1024];
+	int i, cl_size, threads = sysconf(_SC_NPROCESSORS_ONLN);
+	long reps;
+	double ms, mb;
+
+	snprintf(file_name, sizeof(file_name), "%s/bench_%d.txt", dir, n);
+	write_instance(file_name, n);
+	mb = stat(file_name, &st) == 0 ? st.st_size / 1048576. : 0.;
+	ms = clock_ms();
+	load_instance(file_name, 1, &weights);
+	ms = clock_ms() - ms;
+	free_weights(&weights);
+	printf("load,%d,1,%.1lf,MB/s\n", n, mb / (ms / 1000.));
+	ms = clock_ms();
+	load_instance(file_name, threads, &weights);
+	ms = clock_ms() - ms;
+	printf("load,%d,%d,%.1lf,MB/s\n", n, threads, mb / (ms / 1000.));
+	unlink(file_name);
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.pweight = &weights;
+	ctx.pst = &state;
+	ctx.size = n;
+	ctx.b = n / 10 > 2 ? n / 10 : 2;
+	if (alloc_state(n, &state) != ITS_OK || alloc_ctx(&ctx, n) != ITS_OK) {
+		fprintf(out, "  failure in memory allocation\n");
+		exit(1);
+	}
+	rng_seed(&rng, RNG_DEFAULT, BENCH_SEED);
+	random_start(n, ctx.b, ctx.b, &cl_size, &rng, &weights, &state);
+	build_lists(n, &state);
+	compute_gains(n, &weights, &state);
+	memcpy(ctx.keep_sol, state.sol, (n + 1) * sizeof(int));
+	ctx.k = *state.in_list;
+	ctx.m = *state.out_list;
+	memcpy(ctx.row1, weight_row(&weights, ctx.k, state.wbuf),
+			(n + 1) * sizeof(double));
+	memcpy(ctx.row2, weight_row(&weights, ctx.m, state.wbuf),
+			(n + 1) * sizeof(double));
+	for (i = 1; i <= n; i++)
+		*(ctx.clout + i) = *(state.sol + i) == 1 ? -INFINITY
+				: *(state.cl + i);
+
+	ms = time_calls(bench_add_sub, &ctx, min_ms, &reps);
+	printf("gain_add_sub,%d,%s,%.3lf,ns/vertex\n", n, gain_kernel_name(),
+			ms * 1e6 / (2. * n));
+	ms = time_calls(bench_swap, &ctx, min_ms, &reps);
+	printf("gain_swap,%d,%s,%.3lf,ns/vertex\n", n, gain_kernel_name(),
+			ms * 1e6 / (2. * n));
+	ms = time_calls(bench_scan, &ctx, min_ms, &reps);
+	printf("swap_scan,%d,%s,%.3lf,ns/pair\n", n, gain_kernel_name(),
+			ms * 1e6 * reps / (ctx.evaluated > 0 ? ctx.evaluated : 1));
+	time_calls(bench_local, &ctx, min_ms, &reps);
+	printf("local_search,%d,b=%d,%.3lf,ms/call\n", n, ctx.b, ctx.ls_ms / reps);
+	printf("local_search,%d,b=%d,%.3lf,ns/evaluation\n", n, ctx.b,
+			ctx.ls_ms * 1e6 / (ctx.it_count > 0 ? ctx.it_count : 1));
+
+	free(ctx.keep_sol);
+	free(ctx.clout);
+	free(ctx.mask);
+	free(ctx.row1);
+	free(ctx.row2);
+	free_state(&state);
+	free_weights(&weights);
+}
+
+int main(int argc, char **argv) {
+	FILE *out = stdout;
+	const char *dir = "/tmp";
+	char *list = NULL, *p;
+	int orders[BENCH_MAX_ORDERS] = { 500, 1000, 2000 };
+	int count = 3;
+	int c, i;
+	double min_ms = BENCH_MIN_MS;
+
+	while ((c = getopt(argc, argv, "n:d:m:")) != -1) {
+		switch (c) {
+		case 'n':
+			list = optarg;
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 'm':
+			min_ms = atof(optarg);
+			break;
+		default:
+			exit(1);
+		}
+	}
+	if (list != NULL) {
+		count = 0;
+		for (p = strtok(list, ","); p != NULL && count < BENCH_MAX_ORDERS;
+				p = strtok(NULL, ","))
+			if ((orders[count] = atoi(p)) >= 20)
+				count++;
+	}
+	printf("kernel,n,variant,value,unit\n");
+	for (i = 0; i < count; i++)
+		bench_order(out, dir, orders[i], min_ms);
+	return 0;
+}
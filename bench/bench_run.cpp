@@ -0,0 +1,54 @@
+/* Runs a command and appends its wall time in milliseconds, its peak
+ resident set size in kilobytes and its exit status to a file, as
+ "wall_ms,peak_rss_kb,status".
+ Usage: bench_run result_file output_file command [arguments]
+ The standard output of the command goes to output_file (/dev/null to
+ discard it), its standard error is discarded. */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "budget.h"
+
+int main(int argc, char **argv) {
+	FILE *f;
+	struct rusage ru;
+	pid_t pid;
+	int status, fd;
+	double start, wall;
+
+	if (argc < 4) {
+		printf("  usage: bench_run result_file output_file command "
+				"[arguments]\n");
+		exit(1);
+	}
+	start = clock_ms();
+	if ((pid = fork()) < 0) {
+		printf("  fork failed\n");
+		exit(1);
+	}
+	if (pid == 0) {
+		if ((fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644)) >= 0)
+			dup2(fd, 1);
+		if ((fd = open("/dev/null", O_WRONLY)) >= 0)
+			dup2(fd, 2);
+		execvp(argv[3], argv + 3);
+		_exit(127);
+	}
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		printf("  wait4 failed\n");
+		exit(1);
+	}
+	wall = clock_ms() - start;
+	if ((f = fopen(argv[1], "a")) == NULL) {
+		printf("  fopen failed for output  %s\n", argv[1]);
+		exit(1);
+	}
+	fprintf(f, "%.3lf,%ld,%d\n", wall, ru.ru_maxrss,
+			WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+	fclose(f);
+	return 0;
+}
@@ -19,8 +19,38 @@
  through the (input) file. An instance of the problem in this file is
  represented by a list containing all (even zero) coefficients c_ij.
  Internally, the program uses a matrix with entries of 'double' type
- to store these coefficients. The program terminates when a specified
- time limit is reached.
+ to store these coefficients. For very large instances ITS_storage()
+ can keep only the upper triangle of this matrix, with entries of
+ either 'float' or 'double' type (WEIGHTS_PACKED_FLOAT/_DOUBLE in
+ 'ITS.h'); the gains are still accumulated in 'double' and are
+ recomputed exactly every GAIN_RESYNC_PERIOD moves. Sparse graphs can
+ be kept as adjacency lists of the nonzero weights (WEIGHTS_SPARSE),
+ in memory proportional to the number of edges; the gains are then
+ updated over the neighbors of the vertices moved only, and the swaps
+ are scanned as described at sparse_top(). Instances of Euclidean
+ distances can be given by the coordinates of their points instead
+ (WEIGHTS_POINTS), in memory proportional to n times the dimension; the
+ weight rows are then computed when needed (distance_row() in
+ 'kernels.h'). The gains are computed once for the initial solution and
+ then kept up to date incrementally across all perturbations and tabu
+ search runs; with GAIN_VERIFY set they are recomputed at the start of
+ each tabu search and the largest drift found is reported. The program
+ terminates when a specified time limit is reached; ITS_storage() also
+ accepts a limit in milliseconds, a limit on the number of tabu search
+ iterations and a target value (see 'budget.h').
+ ITS_storage() is ITS_load(), which reads the instance, followed by
+ ITS_run(), which solves it. A loaded instance is only read by ITS_run(),
+ so several runs with different seeds may share it from separate threads
+ (as main_ITS does). ITS_coop() solves it with several runs in threads of
+ their own which exchange good solutions through an elite pool
+ ('elite.h').
+ These functions write a report file and return ITS_OK or an error code
+ (ITS_error() gives its text); they print nothing, and main_ITS reports
+ the error and exits. In-process callers use ITS_load() and ITS_solve()
+ instead, which write nothing and keep no global state: the search buffers live in a Solver
+ that is reused from call to call, so repeated solves allocate nothing,
+ and calls with distinct solvers may run concurrently on one instance.
+ ITS_report() writes the report of a solve if one is wanted.
  Parameters:
  - input file name;
  - output file name;
@@ -50,9 +80,11 @@
  strcpy(out_file_name,"D:\\temp\\Type2.1.res");
  ITS(in_file_name,out_file_name,50,50,seed,1000,20,NULL);
  Input file contains:
- - the size n of the instance (the number of vertices of the graph);
+ - the size n of the instance (the number of vertices of the graph),
+ possibly followed on the same line by a number which is ignored;
  - for each pair i, j, i=1,...,n-1, j=i+1,...,n, the triplet:
  i-1, j-1, c_ij.
+ Pairs left out weigh 0, so a sparse graph may list its edges only.
  Example of the input file:
  500
  0 1 704.48
@@ -61,6 +93,9 @@
  0 4 161.76
  .......
  .......
+ The input file may also be a binary instance written by mdp2bin (see
+ 'loader.h'); it is mapped and used in place, in the storage kind it was
+ written with. With WEIGHTS_POINTS it is a point file (see 'loader.h').
  */
 
 #include <memory.h>
@@ -70,24 +105,18 @@
 #include <time.h>
 #include <math.h>
 #include "ITS.h"
+#include "kernels.h"
+#include "elite.h"
 
-double random(double *seed, double coef) {
-	double rd, rf;
-	rd = 16807 * (*seed);
-	rf = floor(rd / coef);
-	*seed = rd - rf * coef;
-	return (*seed / (coef + 1));
-}
-
-long take_time(int *time_values, clock_t start) {
+/* Splits elapsed_ms into hours, minutes, seconds and microseconds
+ (time_values[1..4]); returns the whole seconds. */
+long take_time(int *time_values, double elapsed_ms) {
 	int i;
 	int hours, mins;
 	long longsecs;
-	float elapsed_sec;
-	clock_t end;
-	end = clock();
-	elapsed_sec = (end - start) / CLK_TCK;
-	longsecs = elapsed_sec;
+	double elapsed_sec;
+	elapsed_sec = elapsed_ms / 1000.;
+	longsecs = (long) elapsed_sec;
 	for (i = 1; i <= 4; i++)
 		time_values[i] = 0;
 	hours = (int) (longsecs / 3600);
@@ -103,40 +132,227 @@ long take_time(int *time_values, clock_t start) {
 		longsecs -= mins * 60;
 	}
 	time_values[3] = (int) longsecs;
-	time_values[4] = elapsed_sec * 1000 - (long) elapsed_sec * 1000;
+	time_values[4] = (int) ((elapsed_sec - (long) elapsed_sec) * 1000000);
 	return (long) elapsed_sec;
 }
 
-double random_start(int size, int b1, int b2, int *cl_size, double coef,
-		double *seed, double **pweight, Solution *psol) {
+void put_weight(Weights *pweight, int i, int j, double w) {
+	int k;
+	if (pweight->kind == WEIGHTS_DENSE) {
+		*(wrow(i) + j) = w;
+		*(wrow(j) + i) = w;
+		return;
+	}
+	if (i == j)
+		return;
+	if (i > j) {
+		k = i;
+		i = j;
+		j = k;
+	}
+	if (pweight->kind == WEIGHTS_PACKED_FLOAT)
+		*(pweight->wf + packed_index(pweight->size, i, j)) = (float) w;
+	else
+		*(pweight->w + packed_index(pweight->size, i, j)) = w;
+}
+
+/* Returns row k of the coefficient matrix as a contiguous array indexed
+ 1..size.  Dense storage hands out the row in place; packed and sparse
+ storage expand it (in double) into buf, which must hold size+1 entries,
+ and points have their distances computed into it. */
+double *weight_row(Weights *pweight, int k, double *buf) {
+	int j, size = pweight->size;
+	long lo;
+
+	if (pweight->kind == WEIGHTS_DENSE)
+		return wrow(k);
+	if (pweight->kind == WEIGHTS_POINTS) {
+		distance_row(buf, pweight->w, pweight->stride, pweight->dim, k, size);
+		return buf;
+	}
+	if (pweight->kind == WEIGHTS_SPARSE) {
+		for (j = 1; j <= size; j++)
+			*(buf + j) = 0.;
+		for (lo = *(pweight->xadj + k); lo < *(pweight->xadj + k + 1); lo++)
+			*(buf + *(pweight->adj + lo)) = *(pweight->adjw + lo);
+		return buf;
+	}
+	lo = k - 2;
+	if (pweight->kind == WEIGHTS_PACKED_FLOAT) {
+		for (j = 1; j < k; j++) {
+			*(buf + j) = *(pweight->wf + lo);
+			lo += size - j - 1;
+		}
+		lo = packed_index(size, k, k + 1);
+		for (j = k + 1; j <= size; j++)
+			*(buf + j) = *(pweight->wf + lo++);
+	} else {
+		for (j = 1; j < k; j++) {
+			*(buf + j) = *(pweight->w + lo);
+			lo += size - j - 1;
+		}
+		lo = packed_index(size, k, k + 1);
+		for (j = k + 1; j <= size; j++)
+			*(buf + j) = *(pweight->w + lo++);
+	}
+	*(buf + k) = 0.;
+	return buf;
+}
+
+/* Rebuilds the lists of members and non-members of S from sol. */
+void build_lists(int size, SearchState *pst) {
+	int v;
+
+	pst->in_count = pst->out_count = 0;
+	for (v = 1; v <= size; v++)
+		if (*(pst->sol + v) == 1) {
+			*(pst->pos + v) = pst->in_count;
+			*(pst->in_list + pst->in_count++) = v;
+		} else {
+			*(pst->pos + v) = pst->out_count;
+			*(pst->out_list + pst->out_count++) = v;
+		}
+}
+
+/* Adds vertex v to S.  The last non-member takes the place of v in the
+ list of non-members, so the order of that list changes. */
+void move_in(int v, SearchState *pst) {
+	int last = *(pst->out_list + --pst->out_count);
+
+	*(pst->out_list + *(pst->pos + v)) = last;
+	*(pst->pos + last) = *(pst->pos + v);
+	*(pst->pos + v) = pst->in_count;
+	*(pst->in_list + pst->in_count++) = v;
+	*(pst->sol + v) = 1;
+}
+
+/* Removes vertex v from S, the counterpart of move_in(). */
+void move_out(int v, SearchState *pst) {
+	int last = *(pst->in_list + --pst->in_count);
+
+	*(pst->in_list + *(pst->pos + v)) = last;
+	*(pst->pos + last) = *(pst->pos + v);
+	*(pst->pos + v) = pst->out_count;
+	*(pst->out_list + pst->out_count++) = v;
+	*(pst->sol + v) = 0;
+}
+
+/* Value of the solution psol in sparse storage, summed over the edges. */
+static double sparse_value(const Weights *pweight, const int *psol,
+		int size) {
+	int i, j;
+	long e;
+	double sol_value = 0;
+
+	for (i = 1; i <= size; i++) {
+		if (*(psol + i) != 1)
+			continue;
+		for (e = *(pweight->xadj + i); e < *(pweight->xadj + i + 1); e++) {
+			j = *(pweight->adj + e);
+			if (j > i && *(psol + j) == 1)
+				sol_value += *(pweight->adjw + e);
+		}
+	}
+	return sol_value;
+}
+
+/* cl_j += sign*c_kj for the neighbors j of k in sparse storage, the gain
+ update of adding (sign 1) or removing (sign -1) k. */
+static void sparse_gain(const Weights *pweight, double *pcl, int k,
+		double sign) {
+	long e;
+
+	for (e = *(pweight->xadj + k); e < *(pweight->xadj + k + 1); e++)
+		*(pcl + *(pweight->adj + e)) += sign * *(pweight->adjw + e);
+}
+
+/* Recomputes all gains cl from scratch and returns the exact value of
+ the current solution, summed in the same order as in ITS(). */
+double compute_gains(int size, Weights *pweight, SearchState *pst) {
+	int i, j;
+	int *psol = pst->sol;
+	double *pcl = pst->cl;
+	double *rowi;
+	double sol_value = 0;
+
+	for (i = 1; i <= size; i++)
+		*(pcl + i) = 0.;
+	if (pweight->kind == WEIGHTS_SPARSE) {
+		for (i = 1; i <= size; i++)
+			if (*(psol + i) == 1)
+				sparse_gain(pweight, pcl, i, 1.);
+		return sparse_value(pweight, psol, size);
+	}
+	for (i = 1; i <= size; i++) {
+		if (*(psol + i) != 1)
+			continue;
+		rowi = weight_row(pweight, i, pst->wbuf);
+		for (j = 1; j <= size; j++)
+			*(pcl + j) += *(rowi + j);
+		for (j = i + 1; j <= size; j++)
+			if (*(psol + j) == 1)
+				sol_value += *(rowi + j);
+	}
+	return sol_value;
+}
+
+/* Recomputes the gains and the value of the current solution and records
+ in stats how far the incrementally maintained ones have drifted. */
+double verify_gains(int size, double sol_value, Weights *pweight,
+		SearchState *pst) {
+	int i;
+	double exact, del;
+	double *pcl = pst->cl, *clout = pst->clout;
+
+	for (i = 1; i <= size; i++)
+		*(clout + i) = *(pcl + i);
+	exact = compute_gains(size, pweight, pst);
+	for (i = 1; i <= size; i++) {
+		del = fabs(*(clout + i) - *(pcl + i));
+		if (del > pst->stats.gain_drift)
+			pst->stats.gain_drift = del;
+	}
+	del = fabs(sol_value - exact);
+	if (del > pst->stats.value_drift)
+		pst->stats.value_drift = del;
+	return exact;
+}
+
+double random_start(int size, int b1, int b2, int *cl_size, Rng *prng,
+		Weights *pweight, SearchState *pst) {
 	int i, j, r;
+	int *psol = pst->sol, *pperm = pst->perm;
 	double sol_value = 0;
 
-	i = random(seed, coef) * (b2 - b1 + 1);
+	i = rng_next(prng) * (b2 - b1 + 1);
 	*cl_size = b1 + i;
 	for (i = 1; i <= size; i++) {
-		(psol + i)->t = i;
-		(psol + i)->sol = 0;
+		*(pperm + i) = i;
+		*(psol + i) = 0;
 	}
 	for (i = 1; i <= *cl_size; i++) {
-		r = random(seed, coef) * (size - i + 1);
+		r = rng_next(prng) * (size - i + 1);
 		r += i;
-		(psol + (psol + r)->t)->sol = 1;
-		(psol + r)->t = (psol + i)->t;
+		*(psol + *(pperm + r)) = 1;
+		*(pperm + r) = *(pperm + i);
 	}
+	if (pweight->kind == WEIGHTS_SPARSE)
+		return sparse_value(pweight, psol, size);
 	for (i = 1; i < size; i++) {
-		if ((psol + i)->sol != 1)
+		if (*(psol + i) != 1)
 			continue;
 		for (j = i + 1; j <= size; j++)
-			if ((psol + j)->sol == 1)
+			if (*(psol + j) == 1)
 				sol_value += weight(i,j);
 	}
 	return sol_value;
 }
 
-double steepest_ascent(FILE *out, int size, int b1, int b2, int *cl_size,
-		double coef, double *seed, double **pweight, Solution *psol) {
+double steepest_ascent(int size, int b1, int b2, int *cl_size,
+		Rng *prng, Weights *pweight, SearchState *pst) {
 	int i, j, k, q;
+	int *psol = pst->sol;
+	double *psf = pst->sf, *ps1 = pst->s1;
 	int m0 = 0, m1 = 0;
 	int count;
 	int cs = 0, ind, val;
@@ -151,25 +367,25 @@ double steepest_ascent(FILE *out, int size, int b1, int b2, int *cl_size,
 	else
 		q = (b1 + b2) / 2;
 	for (i = 1; i <= size; i++) {
-		(psol + i)->sol = -1;
-		(psol + i)->sf = 0;
-		(psol + i)->s1 = 0;
+		*(psol + i) = -1;
+		*(psf + i) = 0;
+		*(ps1 + i) = 0;
 	}
 	for (i = 1; i < size; i++)
 		for (j = i + 1; j <= size; j++) {
 			f += (weight(i,j));
-			(psol + i)->sf += (weight(i,j));
-			(psol + j)->sf += (weight(i,j));
+			*(psf + i) += (weight(i,j));
+			*(psf + j) += (weight(i,j));
 		}
 	f *= (q * q);
 	for (k = 1; k <= size; k++) {
 		max_impr = NEG_LARGE_LONG;
 		ind = -1;
 		for (i = 1; i <= size; i++) {
-			if ((psol + i)->sol != -1)
+			if (*(psol + i) != -1)
 				continue;
-			db = ((double) q) * (psol + i)->sf
-					+ ((double) size) * (psol + i)->s1;
+			db = ((double) q) * *(psf + i)
+					+ ((double) size) * *(ps1 + i);
 			impr0 = -q * db;
 			if (impr0 > max_impr) {
 				max_impr = impr0;
@@ -178,7 +394,7 @@ double steepest_ascent(FILE *out, int size, int b1, int b2, int *cl_size,
 				count = 1;
 			} else if (impr0 == max_impr) {
 				count++;
-				dr_numb = random(seed, coef);
+				dr_numb = rng_next(prng);
 				if (dr_numb <= 1. / (double) count) {
 					ind = i;
 					val = 0;
@@ -192,7 +408,7 @@ double steepest_ascent(FILE *out, int size, int b1, int b2, int *cl_size,
 				count = 1;
 			} else if (impr1 == max_impr) {
 				count++;
-				dr_numb = random(seed, coef);
+				dr_numb = rng_next(prng);
 				if (dr_numb <= 1. / (double) count) {
 					ind = i;
 					val = 1;
@@ -200,7 +416,7 @@ double steepest_ascent(FILE *out, int size, int b1, int b2, int *cl_size,
 			}
 		}
 		f += max_impr;
-		(psol + ind)->sol = val;
+		*(psol + ind) = val;
 		if (val == 0)
 			m0++;
 		else {
@@ -208,11 +424,11 @@ double steepest_ascent(FILE *out, int size, int b1, int b2, int *cl_size,
 			(*cl_size)++;
 		}
 		for (i = 1; i <= size; i++) {
-			if ((psol + i)->sol != -1 || weight(i,ind) == 0)
+			if (*(psol + i) != -1 || weight(i,ind) == 0)
 				continue;
 			if (val == 1)
-				(psol + i)->s1 += weight(i,ind);
-			(psol + i)->sf -= weight(i,ind);
+				*(ps1 + i) += weight(i,ind);
+			*(psf + i) -= weight(i,ind);
 		}
 		if (m1 == b2) {
 			cs = 1;
@@ -225,34 +441,34 @@ double steepest_ascent(FILE *out, int size, int b1, int b2, int *cl_size,
 	}
 	if (cs > 0) {
 		for (k = 1; k <= size; k++) {
-			if ((psol + k)->sol != -1)
+			if (*(psol + k) != -1)
 				continue;
-			db = ((double) q) * (psol + k)->sf
-					+ ((double) size) * (psol + k)->s1;
+			db = ((double) q) * *(psf + k)
+					+ ((double) size) * *(ps1 + k);
 			impr0 = -q * db;
 			f += impr0;
-			(psol + k)->sol = 0;
+			*(psol + k) = 0;
 			for (i = k + 1; i <= size; i++) {
-				if ((psol + i)->sol != -1 || weight(i,k) == 0)
+				if (*(psol + i) != -1 || weight(i,k) == 0)
 					continue;
-				(psol + i)->sf -= (weight(i,k));
+				*(psf + i) -= (weight(i,k));
 			}
 		}
 	} else if (cs < 0) {
 		for (k = 1; k <= size; k++) {
-			if ((psol + k)->sol != -1)
+			if (*(psol + k) != -1)
 				continue;
-			db = ((double) q) * (psol + k)->sf
-					+ ((double) size) * (psol + k)->s1;
+			db = ((double) q) * *(psf + k)
+					+ ((double) size) * *(ps1 + k);
 			impr1 = (size - q) * db;
 			f += impr1;
-			(psol + k)->sol = 1;
+			*(psol + k) = 1;
 			(*cl_size)++;
 			for (i = k + 1; i <= size; i++) {
-				if ((psol + i)->sol != -1 || weight(i,k) == 0)
+				if (*(psol + i) != -1 || weight(i,k) == 0)
 					continue;
-				(psol + i)->s1 += (weight(i,k));
-				(psol + i)->sf -= (weight(i,k));
+				*(ps1 + i) += (weight(i,k));
+				*(psf + i) -= (weight(i,k));
 			}
 		}
 	}
@@ -260,523 +476,1946 @@ double steepest_ascent(FILE *out, int size, int b1, int b2, int *cl_size,
 	f /= size;
 	f_value = f;
 	for (i = 1; i < size; i++) {
-		if ((psol + i)->sol != 1)
+		if (*(psol + i) != 1)
 			continue;
 		for (j = i + 1; j <= size; j++)
-			if ((psol + j)->sol == 1)
+			if (*(psol + j) == 1)
 				sol_value += weight(i,j);
 	}
-	if (f_value < sol_value - 0.00001 || f_value > sol_value + 0.00001) {
-		fprintf(out, "!!! discrepancy in solution values: %11.3lf   %11.3lf\n",
-				f_value, sol_value);
-		exit(1);
-	}
+	if (f_value < sol_value - 0.00001 || f_value > sol_value + 0.00001)
+		pst->status = ITS_ERR_INTERNAL;
 	return sol_value;
 }
 
+/* Keeps in heap[0..*count-1] the at most cap vertices of list[0..n-1]
+ with the largest sign*cl, as a heap with the smallest of them at the
+ root. */
+static void heap_select(const int *list, int n, double sign,
+		const double *pcl, int cap, int *heap, int *count) {
+	int i, j, c, v;
+	double key;
+
+	*count = 0;
+	for (i = 0; i < n; i++) {
+		v = *(list + i);
+		key = sign * *(pcl + v);
+		if (*count < cap) {
+			/* sift up */
+			for (j = (*count)++; j > 0; j = c) {
+				c = (j - 1) / 2;
+				if (sign * *(pcl + *(heap + c)) <= key)
+					break;
+				*(heap + j) = *(heap + c);
+			}
+			*(heap + j) = v;
+		} else if (key > sign * *(pcl + *heap)) {
+			/* replace the root and sift down */
+			for (j = 0; (c = 2 * j + 1) < cap; j = c) {
+				if (c + 1 < cap && sign * *(pcl + *(heap + c + 1))
+						< sign * *(pcl + *(heap + c)))
+					c++;
+				if (sign * *(pcl + *(heap + c)) >= key)
+					break;
+				*(heap + j) = *(heap + c);
+			}
+			*(heap + j) = v;
+		}
+	}
+}
+
+/* Sifts v down from heap[j] into heap[0..n-1], a heap with the largest
+ sign*cl at the root but for position j. */
+static void heap_down(int *heap, int n, int j, int v, double sign,
+		const double *pcl) {
+	int c;
+	double key = sign * *(pcl + v);
+
+	for (; (c = 2 * j + 1) < n; j = c) {
+		if (c + 1 < n && sign * *(pcl + *(heap + c + 1))
+				> sign * *(pcl + *(heap + c)))
+			c++;
+		if (sign * *(pcl + *(heap + c)) <= key)
+			break;
+		*(heap + j) = *(heap + c);
+	}
+	*(heap + j) = v;
+}
+
+/* Makes heap[0..n-1] a heap with the largest sign*cl at the root. */
+static void heap_build(int *heap, int n, double sign, const double *pcl) {
+	int j;
+
+	for (j = n / 2 - 1; j >= 0; j--)
+		heap_down(heap, n, j, *(heap + j), sign, pcl);
+}
+
+/* Moves the root of the heap heap[0..n-1] to heap[n-1], leaving a heap
+ in heap[0..n-2]: popping all of it sorts the vertices by increasing
+ sign*cl. */
+static void heap_pop(int *heap, int n, double sign, const double *pcl) {
+	int v = *(heap + n - 1);
+
+	*(heap + n - 1) = *heap;
+	heap_down(heap, n - 1, 0, v, sign, pcl);
+}
+
+/* Sparse storage: a swap of member k and non-member m changes the
+ objective by cl_m-cl_k-c_km, which is cl_m-cl_k unless m is a neighbor
+ of k. The best swap of k is thus either one with a neighbor, evaluated
+ one by one, or the one with the non-member of largest gain that is not
+ a neighbor (nor excluded otherwise). That one is among the deg(k)+1
+ non-members of largest gain, plus one for each further exclusion, so
+ a swap scan takes the want non-members of largest gain, with want
+ covering the members scanned, once into pst->top instead of looking at
+ all pairs. Only the non-members adjacent to S have nonzero gains (up to
+ rounding), so these are looked at, together with want others, which
+ all have gain 0 and serve equally well.
+ Puts into top[0..] the at most want non-members v with the largest
+ gains, skip[v] not set, in decreasing order of gain; returns their
+ number. */
+static int sparse_top(int want, const int *skip, Weights *pweight,
+		SearchState *pst) {
+	int i, k, v, count = 0, far = 0;
+	int *top = pst->top, *near = pst->top + pst->out_count + 1;
+	int *psol = pst->sol, *pmark = pst->mark;
+	long e;
+	double *pcl = pst->cl;
+
+	for (i = 0; i < pst->in_count; i++) {
+		k = *(pst->in_list + i);
+		for (e = *(pweight->xadj + k); e < *(pweight->xadj + k + 1); e++) {
+			v = *(pweight->adj + e);
+			if (*(psol + v) == 1 || *(pmark + v) > 0
+					|| (skip != NULL && *(skip + v) > 0))
+				continue;
+			*(pmark + v) = 1;
+			*(near + count++) = v;
+		}
+	}
+	for (i = 0; i < pst->out_count && far < want; i++) {
+		v = *(pst->out_list + i);
+		if (*(pmark + v) > 0 || (skip != NULL && *(skip + v) > 0))
+			continue;
+		*(near + count + far++) = v;
+	}
+	for (i = 0; i < count; i++)
+		*(pmark + *(near + i)) = 0;
+	heap_select(near, count + far, 1., pcl, want, top, &count);
+	/* popping the heap, whose root is the smallest, sorts it by decreasing
+	 gain */
+	for (i = count; i > 1; i--)
+		heap_pop(top, i, -1., pcl);
+	return count;
+}
+
+/* Largest degree of the members of S with skip[v] not set, if skip is
+ not NULL. */
+static int sparse_degree(const Weights *pweight, const int *skip,
+		SearchState *pst) {
+	int i, k;
+	long d, max = 0;
+
+	for (i = 0; i < pst->in_count; i++) {
+		k = *(pst->in_list + i);
+		if (skip != NULL && *(skip + k) > 0)
+			continue;
+		d = *(pweight->xadj + k + 1) - *(pweight->xadj + k);
+		if (d > max)
+			max = d;
+	}
+	return max;
+}
+
+/* Offers the move of k (and m, if not -1) changing the objective by del
+ to the candidate list of get_solution, which keeps the cand_list_size
+ best moves offered; *minval and *minind give its worst entry. */
+static void cand_offer(Candidates *pcand, int cand_list_size,
+		int *cand_count, double *minval, int *minind, int k, int m,
+		double del) {
+	int r;
+
+	if (*cand_count < cand_list_size) {
+		(*cand_count)++;
+		*(pcand->cand1 + *cand_count) = k;
+		*(pcand->cand2 + *cand_count) = m;
+		*(pcand->d + *cand_count) = del;
+		if (del < *minval) {
+			*minval = del;
+			*minind = *cand_count;
+		}
+	} else if (del > *minval) {
+		*(pcand->cand1 + *minind) = k;
+		*(pcand->cand2 + *minind) = m;
+		*(pcand->d + *minind) = del;
+		*minval = *(pcand->d + 1);
+		*minind = 1;
+		for (r = 2; r <= *cand_count; r++)
+			if (*(pcand->d + r) < *minval) {
+				*minval = *(pcand->d + r);
+				*minind = r;
+			}
+	}
+}
+
 double get_solution(int size, int b1, int b2, int perturb_count,
-		int cand_list_size, double init_value, int *cl_size, double coef,
-		double *seed, double **pweight, Solution *psol) {
-	int i, j, k, m;
+		int cand_list_size, double init_value, int *cl_size, Rng *prng,
+		Weights *pweight, SearchState *pst) {
+	int i, j, k, m, r;
 	int it = 0;
-	int ind, ind1, ind2, minind, cand_count;
+	int ind, ind1, ind2, minind, cand_count, nin, nout, popped, ntop;
+	int *psol = pst->sol, *pval = pst->val, *pmark = pst->mark;
+	int *pin = pst->in_list, *pout = pst->out_list;
+	int *hout = pst->order, *hin = pst->order + size + 1;
+	int *pcand1 = pst->cand.cand1, *pcand2 = pst->cand.cand2;
 	double sol_value;
-	double minval, del;
+	double minval, max_out;
+	double *pcl = pst->cl, *pd = pst->cand.d, *wbuf = pst->wbuf;
+	double *row1, *row2, *rowk;
+	long e;
 
 	sol_value = init_value;
 	for (i = 1; i <= size; i++)
-		(psol + i)->val = 0;
+		*(pval + i) = 0;
 
 	while (it < perturb_count) {
 		cand_count = 0;
 		minval = POS_LARGE_INT;
 		if (*cl_size < b2)
-			for (k = 1; k <= size; k++) {
-				if ((psol + k)->val > 0 || (psol + k)->sol == 1)
+			for (i = 0; i < pst->out_count; i++) {
+				k = *(pout + i);
+				if (*(pval + k) > 0)
 					continue;
-				if (cand_count < cand_list_size) {
-					cand_count++;
-					(psol + cand_count)->cand1 = k;
-					(psol + cand_count)->cand2 = -1;
-					(psol + cand_count)->d = (psol + k)->cl;
-					if ((psol + k)->cl < minval) {
-						minval = (psol + k)->cl;
-						minind = cand_count;
-					}
-				} else if ((psol + k)->cl > minval) {
-					(psol + minind)->cand1 = k;
-					(psol + minind)->cand2 = -1;
-					(psol + minind)->d = (psol + k)->cl;
-					minval = (psol + 1)->d;
-					minind = 1;
-					for (j = 2; j <= cand_count; j++)
-						if ((psol + j)->d < minval) {
-							minval = (psol + j)->d;
-							minind = j;
-						}
-				}
+				cand_offer(&pst->cand, cand_list_size, &cand_count, &minval,
+						&minind, k, -1, *(pcl + k));
 			}
 		if (*cl_size > b1)
-			for (k = 1; k <= size; k++) {
-				if ((psol + k)->val > 0 || (psol + k)->sol == 0)
+			for (i = 0; i < pst->in_count; i++) {
+				k = *(pin + i);
+				if (*(pval + k) > 0)
 					continue;
-				if (cand_count < cand_list_size) {
-					cand_count++;
-					(psol + cand_count)->cand1 = k;
-					(psol + cand_count)->cand2 = -1;
-					(psol + cand_count)->d = -(psol + k)->cl;
-					if (-(psol + k)->cl < minval) {
-						minval = -(psol + k)->cl;
-						minind = cand_count;
-					}
-				} else if (-(psol + k)->cl > minval) {
-					(psol + minind)->cand1 = k;
-					(psol + minind)->cand2 = -1;
-					(psol + minind)->d = -(psol + k)->cl;
-					minval = (psol + 1)->d;
-					minind = 1;
-					for (j = 2; j <= cand_count; j++)
-						if ((psol + j)->d < minval) {
-							minval = (psol + j)->d;
-							minind = j;
-						}
-				}
+				cand_offer(&pst->cand, cand_list_size, &cand_count, &minval,
+						&minind, k, -1, -*(pcl + k));
 			}
-		if ((*cl_size == b1 || *cl_size == b2))
-			for (k = 1; k <= size; k++) {
-				if ((psol + k)->val > 0 || (psol + k)->sol == 0)
+		/* the swaps are scanned from heaps on the gains as in local_search;
+		 once the list is full, either scan stops where cl_m-cl_k-wmin no
+		 longer beats its smallest entry. In sparse storage only the first
+		 cand_list_size non-neighbors of k in pst->top can make the list
+		 (see sparse_top) */
+		if ((*cl_size == b1 || *cl_size == b2)
+				&& pweight->kind == WEIGHTS_SPARSE) {
+			ntop = sparse_top(sparse_degree(pweight, pval, pst)
+					+ cand_list_size, pval, pweight, pst);
+			max_out = ntop > 0 ? *(pcl + *pst->top) : -INFINITY;
+			for (i = 0; i < pst->in_count; i++) {
+				k = *(pin + i);
+				if (*(pval + k) > 0)
+					continue;
+				if (cand_count == cand_list_size
+						&& max_out - *(pcl + k) - pst->wmin <= minval)
 					continue;
-				for (m = 1; m <= size; m++) {
-					if ((psol + m)->val > 0 || (psol + m)->sol == 1)
+				for (e = *(pweight->xadj + k); e < *(pweight->xadj + k + 1);
+						e++)
+					*(pmark + *(pweight->adj + e)) = 1;
+				for (j = 0, r = 0; j < ntop && r < cand_list_size; j++) {
+					m = *(pst->top + j);
+					if (*(pmark + m) > 0)
 						continue;
-					del = (psol + m)->cl - (psol + k)->cl - weight(k,m);
-					if (cand_count < cand_list_size) {
-						cand_count++;
-						(psol + cand_count)->cand1 = k;
-						(psol + cand_count)->cand2 = m;
-						(psol + cand_count)->d = del;
-						if (del < minval) {
-							minval = del;
-							minind = cand_count;
-						}
-					} else if (del > minval) {
-						(psol + minind)->cand1 = k;
-						(psol + minind)->cand2 = m;
-						(psol + minind)->d = del;
-						minval = (psol + 1)->d;
-						minind = 1;
-						for (j = 2; j <= cand_count; j++)
-							if ((psol + j)->d < minval) {
-								minval = (psol + j)->d;
-								minind = j;
-							}
-					}
+					r++;
+					cand_offer(&pst->cand, cand_list_size, &cand_count,
+							&minval, &minind, k, m, *(pcl + m) - *(pcl + k));
+				}
+				for (e = *(pweight->xadj + k); e < *(pweight->xadj + k + 1);
+						e++) {
+					m = *(pweight->adj + e);
+					*(pmark + m) = 0;
+					if (*(psol + m) == 1 || *(pval + m) > 0)
+						continue;
+					cand_offer(&pst->cand, cand_list_size, &cand_count,
+							&minval, &minind, k, m,
+							*(pcl + m) - *(pcl + k) - *(pweight->adjw + e));
 				}
 			}
-		ind = random(seed, coef) * cand_count + 1;
-		ind1 = (psol + ind)->cand1;
-		ind2 = (psol + ind)->cand2;
+		} else if ((*cl_size == b1 || *cl_size == b2)) {
+			nin = nout = 0;
+			for (i = 0; i < pst->out_count; i++)
+				if (*(pval + *(pout + i)) == 0)
+					*(hout + nout++) = *(pout + i);
+			for (i = 0; i < pst->in_count; i++)
+				if (*(pval + *(pin + i)) == 0)
+					*(hin + nin++) = *(pin + i);
+			heap_build(hout, nout, 1., pcl);
+			heap_build(hin, nin, -1., pcl);
+			if (nout > 0)
+				heap_pop(hout, nout, 1., pcl);
+			max_out = nout > 0 ? *(pcl + *(hout + nout - 1)) : -INFINITY;
+			popped = 1;
+			for (i = nin; i > 0 && nout > 0; i--) {
+				heap_pop(hin, i, -1., pcl);
+				k = *(hin + i - 1);
+				if (cand_count == cand_list_size
+						&& max_out - *(pcl + k) - pst->wmin <= minval)
+					break;
+				rowk = weight_row(pweight, k, wbuf);
+				for (j = 0; j < nout; j++) {
+					if (j == popped)
+						heap_pop(hout, nout - popped++, 1., pcl);
+					m = *(hout + nout - 1 - j);
+					if (cand_count == cand_list_size
+							&& *(pcl + m) - *(pcl + k) - pst->wmin <= minval)
+						break;
+					cand_offer(&pst->cand, cand_list_size, &cand_count,
+							&minval, &minind, k, m,
+							*(pcl + m) - *(pcl + k) - *(rowk + m));
+				}
+			}
+		}
+		ind = rng_next(prng) * cand_count + 1;
+		ind1 = *(pcand1 + ind);
+		ind2 = *(pcand2 + ind);
+		row1 = pweight->kind == WEIGHTS_SPARSE ? NULL
+				: weight_row(pweight, ind1, wbuf);
 		if (ind2 == -1) {
-			if ((psol + ind1)->sol == 1) {
-				for (j = 1; j <= size; j++)
-					if (j != ind1)
-						(psol + j)->cl -= (weight(j,ind1));
+			if (*(psol + ind1) == 1) {
+				if (row1 == NULL)
+					sparse_gain(pweight, pcl, ind1, -1.);
+				else
+					gain_sub(pcl, row1, size, ind1);
+				move_out(ind1, pst);
 				(*cl_size)--;
 			} else {
-				for (j = 1; j <= size; j++)
-					if (j != ind1)
-						(psol + j)->cl += (weight(j,ind1));
+				if (row1 == NULL)
+					sparse_gain(pweight, pcl, ind1, 1.);
+				else
+					gain_add(pcl, row1, size, ind1);
+				move_in(ind1, pst);
 				(*cl_size)++;
 			}
-			(psol + ind1)->sol = 1 - (psol + ind1)->sol;
-			(psol + ind1)->val = 1;
+			*(pval + ind1) = 1;
 			it++;
 		} else {
-			for (j = 1; j <= size; j++) {
-				if (j != ind1)
-					(psol + j)->cl -= (weight(j,ind1));
-				if (j != ind2)
-					(psol + j)->cl += (weight(j,ind2));
-			}
-			(psol + ind1)->sol = 0;
-			(psol + ind2)->sol = 1;
-			(psol + ind1)->val = (psol + ind2)->val = 1;
+			if (row1 == NULL) {
+				sparse_gain(pweight, pcl, ind1, -1.);
+				sparse_gain(pweight, pcl, ind2, 1.);
+			} else {
+				row2 = weight_row(pweight, ind2, wbuf + size + 1);
+				gain_swap(pcl, row1, row2, size, ind1, ind2,
+						FUSED_GAIN_UPDATE);
+			}
+			move_out(ind1, pst);
+			move_in(ind2, pst);
+			*(pval + ind1) = *(pval + ind2) = 1;
 			it += 2;
 		}
-		sol_value += (psol + ind)->d;
+		sol_value += *(pd + ind);
 	}
 	return sol_value;
 }
 
+/* Looks for an improving swap among the pst->rcl_size members with the
+ smallest gains and the pst->rcl_size non-members with the largest ones;
+ returns 1 and the swap in *ind1, *ind2 and *del if there is one. */
+static int swap_candidates(int size, long *it_count, Weights *pweight,
+		SearchState *pst, int *ind1, int *ind2, double *del) {
+	int i, j, k, m;
+	int nin, nout;
+	int *pin = pst->rcl_in, *pout = pst->rcl_out;
+	double *pcl = pst->cl;
+	double *rowk;
+
+	heap_select(pst->out_list, pst->out_count, 1., pcl, pst->rcl_size, pout,
+			&nout);
+	heap_select(pst->in_list, pst->in_count, -1., pcl, pst->rcl_size, pin,
+			&nin);
+	for (i = 0; i < nin; i++) {
+		k = *(pin + i);
+		rowk = weight_row(pweight, k, pst->wbuf);
+		for (j = 0; j < nout; j++) {
+			m = *(pout + j);
+			(*it_count)++;
+			*del = *(pcl + m) - *(pcl + k) - *(rowk + m);
+			if (*del > 0.00001) {
+				*ind1 = k;
+				*ind2 = m;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/* Sets mask[v] for the vertices v forming a tabu pair with the member k
+ and returns how many of them are out of S, that is the swaps of k that
+ are tabu. unmask_pairs() clears the mask again. */
+static int mask_pairs(SearchState *pst, int k, int *mask) {
+	TabuPair *pair;
+	int r, v, count = 0;
+
+	for (r = 0; r < pst->pair_count; r++) {
+		pair = pst->pairs + (pst->pair_first + r) % (TABU_TIME2 + 1);
+		if (pair->k == k)
+			v = pair->m;
+		else if (pair->m == k)
+			v = pair->k;
+		else
+			continue;
+		if (*(mask + v) == 0 && *(pst->sol + v) == 0)
+			count++;
+		*(mask + v) = 1;
+	}
+	return count;
+}
+
+static void unmask_pairs(SearchState *pst, int *mask) {
+	TabuPair *pair;
+	int r;
+
+	for (r = 0; r < pst->pair_count; r++) {
+		pair = pst->pairs + (pst->pair_first + r) % (TABU_TIME2 + 1);
+		*(mask + pair->k) = *(mask + pair->m) = 0;
+	}
+}
+
+/* Swap step of tabu_search and local_search in sparse storage (see
+ sparse_top): finds the best swap, leaving out the tabu pairs if tabu is
+ set. Returns 0 if there is none, 1 if the swap in *ind1, *ind2 changing
+ the objective by *best is found and 2 if it also takes the value beyond
+ limit. *it is charged with all pairs, as by the full scan. */
+static int swap_sparse(double sol_value, double limit, int tabu, long *it,
+		Weights *pweight, SearchState *pst, int *ind1, int *ind2,
+		double *best) {
+	int i, j, k, m;
+	int ntop, pairs = tabu ? pst->pair_count : 0;
+	int *psol = pst->sol, *pmask = pst->pair_mask, *pmark = pst->mark;
+	int found = 0;
+	long e, lo, hi;
+	double *pcl = pst->cl;
+	double del;
+
+	ntop = sparse_top(sparse_degree(pweight, NULL, pst) + pairs + 1, NULL,
+			pweight, pst);
+	*best = -INFINITY;
+	for (i = 0; i < pst->in_count; i++) {
+		k = *(pst->in_list + i);
+		lo = *(pweight->xadj + k);
+		hi = *(pweight->xadj + k + 1);
+		if (tabu)
+			mask_pairs(pst, k, pmask);
+		for (e = lo; e < hi; e++)
+			*(pmark + *(pweight->adj + e)) = 1;
+		for (j = 0; j < ntop; j++) {
+			m = *(pst->top + j);
+			if (*(pmark + m) > 0 || *(pmask + m) > 0)
+				continue;
+			del = *(pcl + m) - *(pcl + k);
+			if (del > *best) {
+				*best = del;
+				*ind1 = k;
+				*ind2 = m;
+				found = 1;
+			}
+			break;
+		}
+		for (e = lo; e < hi; e++) {
+			m = *(pweight->adj + e);
+			*(pmark + m) = 0;
+			if (*(psol + m) == 1 || *(pmask + m) > 0)
+				continue;
+			del = *(pcl + m) - *(pcl + k) - *(pweight->adjw + e);
+			if (del > *best) {
+				*best = del;
+				*ind1 = k;
+				*ind2 = m;
+				found = 1;
+			}
+		}
+		if (tabu)
+			unmask_pairs(pst, pmask);
+	}
+	*it += (long) pst->in_count * pst->out_count - pairs;
+	if (found == 0)
+		return 0;
+	return sol_value + *best > limit ? 2 : 1;
+}
+
 double local_search(int size, int b1, int b2, int *cl_size, long *it_count,
-		double **pweight, Solution *psol) {
-	int j, k, m;
+		Weights *pweight, SearchState *pst) {
+	int i, j, k, m, nin, nout, popped, found;
 	int repeat = 1;
-	double del;
+	int *pin = pst->in_list, *pout = pst->out_list;
+	int *hout = pst->order, *hin = pst->order + size + 1;
+	double del, max_out;
 	double value_change = 0;
+	double *pcl = pst->cl, *wbuf = pst->wbuf;
+	double *rowk, *rowm;
 
 	while (repeat > 0) {
 		repeat = 0;
 		if (*cl_size < b2)
-			for (k = 1; k <= size; k++) {
-				if ((psol + k)->sol == 1)
-					continue;
+			for (i = 0; i < pst->out_count; i++) {
+				k = *(pout + i);
 				(*it_count)++;
-				if ((psol + k)->cl <= 0.00001)
+				if (*(pcl + k) <= 0.00001)
 					continue;
 				repeat = 1;
-				((psol + 2)->performance)++;
-				(psol + k)->sol = 1;
-				value_change += (psol + k)->cl;
-				for (j = 1; j <= size; j++)
-					if (j != k)
-						(psol + j)->cl += (weight(j,k));
+				(pst->stats.ls_moves)++;
+				move_in(k, pst);
+				i--;
+				value_change += *(pcl + k);
+				if (pweight->kind == WEIGHTS_SPARSE)
+					sparse_gain(pweight, pcl, k, 1.);
+				else {
+					rowk = weight_row(pweight, k, wbuf);
+					gain_add(pcl, rowk, size, k);
+				}
 				(*cl_size)++;
 				if (*cl_size >= b2)
 					break;
 			}
 		if (*cl_size > b1)
-			for (k = 1; k <= size; k++) {
-				if ((psol + k)->sol == 0)
-					continue;
+			for (i = 0; i < pst->in_count; i++) {
+				k = *(pin + i);
 				(*it_count)++;
-				if ((psol + k)->cl >= -0.00001)
+				if (*(pcl + k) >= -0.00001)
 					continue;
 				repeat = 1;
-				((psol + 2)->performance)++;
-				(psol + k)->sol = 0;
-				value_change -= (psol + k)->cl;
-				for (j = 1; j <= size; j++)
-					if (j != k)
-						(psol + j)->cl -= (weight(j,k));
+				(pst->stats.ls_moves)++;
+				move_out(k, pst);
+				i--;
+				value_change -= *(pcl + k);
+				if (pweight->kind == WEIGHTS_SPARSE)
+					sparse_gain(pweight, pcl, k, -1.);
+				else {
+					rowk = weight_row(pweight, k, wbuf);
+					gain_sub(pcl, rowk, size, k);
+				}
 				(*cl_size)--;
 				if (*cl_size <= b1)
 					break;
 			}
-		if ((*cl_size == b1 || *cl_size == b2))
-			for (k = 1; k <= size; k++) {
-				if ((psol + k)->sol == 0)
-					continue;
-				for (m = 1; m <= size; m++) {
-					if ((psol + m)->sol == 1)
-						continue;
+		/* with candidate lists, take the improving swaps among them
+		 first; the full scan below then mostly confirms a local optimum */
+		if (pst->rcl_size > 0 && (*cl_size == b1 || *cl_size == b2))
+			while (swap_candidates(size, it_count, pweight, pst, &k, &m,
+					&del)) {
+				repeat = 1;
+				(pst->stats.ls_moves)++;
+				move_out(k, pst);
+				move_in(m, pst);
+				value_change += del;
+				rowk = weight_row(pweight, k, wbuf);
+				rowm = weight_row(pweight, m, wbuf + size + 1);
+				gain_swap(pcl, rowk, rowm, size, k, m, FUSED_GAIN_UPDATE);
+			}
+		/* sparse storage takes the best swap rather than the first
+		 improving one, as it finds it without scanning all pairs */
+		if ((*cl_size == b1 || *cl_size == b2)
+				&& pweight->kind == WEIGHTS_SPARSE) {
+			if (swap_sparse(0., INFINITY, 0, it_count, pweight, pst, &k, &m,
+					&del) > 0 && del > 0.00001) {
+				repeat = 1;
+				(pst->stats.ls_moves)++;
+				move_out(k, pst);
+				move_in(m, pst);
+				value_change += del;
+				sparse_gain(pweight, pcl, k, -1.);
+				sparse_gain(pweight, pcl, m, 1.);
+			}
+		/* the members are taken by increasing gain and, for each, the
+		 non-members by decreasing gain, popped from heaps on the gains
+		 only as far as needed; the popped non-members pile up at the end
+		 of hout. A swap of k and m gains at most cl_m-cl_k-wmin, so a
+		 scan stops where this is no improvement, and the first improving
+		 swap found ends the pass. The pairs passed over are still counted
+		 as evaluated, as tabu_search charges its runs by the moves
+		 evaluated */
+		} else if ((*cl_size == b1 || *cl_size == b2)) {
+			nin = pst->in_count;
+			nout = pst->out_count;
+			memcpy(hin, pin, nin * sizeof(int));
+			memcpy(hout, pout, nout * sizeof(int));
+			heap_build(hin, nin, -1., pcl);
+			heap_build(hout, nout, 1., pcl);
+			if (nout > 0)
+				heap_pop(hout, nout, 1., pcl);
+			max_out = nout > 0 ? *(pcl + *(hout + nout - 1)) : -INFINITY;
+			popped = 1;
+			found = 0;
+			for (i = nin; i > 0 && found == 0; i--) {
+				heap_pop(hin, i, -1., pcl);
+				k = *(hin + i - 1);
+				if (max_out - *(pcl + k) - pst->wmin <= 0.00001) {
+					*it_count += (long) i * nout;
+					break;
+				}
+				rowk = weight_row(pweight, k, wbuf);
+				for (j = 0; j < nout; j++) {
+					if (j == popped)
+						heap_pop(hout, nout - popped++, 1., pcl);
+					m = *(hout + nout - 1 - j);
+					if (*(pcl + m) - *(pcl + k) - pst->wmin <= 0.00001) {
+						*it_count += nout - j;
+						break;
+					}
 					(*it_count)++;
-					del = (psol + m)->cl - (psol + k)->cl - weight(k,m);
+					del = *(pcl + m) - *(pcl + k) - *(rowk + m);
 					if (del <= 0.00001)
 						continue;
-					repeat = 1;
-					((psol + 2)->performance)++;
-					(psol + k)->sol = 0;
-					(psol + m)->sol = 1;
+					repeat = found = 1;
+					(pst->stats.ls_moves)++;
+					move_out(k, pst);
+					move_in(m, pst);
 					value_change += del;
-					for (j = 1; j <= size; j++) {
-						if (j != k)
-							(psol + j)->cl -= (weight(j,k));
-						if (j != m)
-							(psol + j)->cl += (weight(j,m));
-					}
+					rowm = weight_row(pweight, m, wbuf + size + 1);
+					gain_swap(pcl, rowk, rowm, size, k, m, FUSED_GAIN_UPDATE);
 					break;
 				}
 			}
+		}
 	}
 	return value_change;
 }
 
+/* Swap step of tabu_search restricted to the pst->rcl_size non-members
+ with the largest gains and the pst->rcl_size members with the smallest
+ ones. A swap of any other pair changes the objective by at most
+ bound = max(cl of the excluded non-members) - min(cl of members)
+ - (smallest weight), or symmetrically for the excluded members. The
+ best non-tabu restricted swap is therefore a best swap overall if it
+ reaches bound; returns 0 if it does not, so the caller scans the full
+ neighborhood, 1 if the swap in *ind1, *ind2 is taken and 2 if it is
+ also an aspirating one. The full scan would have evaluated all pairs,
+ which is what *it is charged, so that the tabu search runs as long as
+ without the lists. */
+static int swap_restricted(int size, double sol_value, double limit,
+		long *it, Weights *pweight, SearchState *pst, int *ind1, int *ind2,
+		double *best) {
+	int i, j, k, m;
+	int nin, nout;
+	int *pin = pst->rcl_in, *pout = pst->rcl_out, *pmask = pst->pair_mask;
+	int found = 0;
+	double *pcl = pst->cl;
+	double bound = -INFINITY, del;
+	double min_in, max_out;
+	double *rowk;
+
+	heap_select(pst->out_list, pst->out_count, 1., pcl, pst->rcl_size, pout,
+			&nout);
+	heap_select(pst->in_list, pst->in_count, -1., pcl, pst->rcl_size, pin,
+			&nin);
+	if (nin == 0 || nout == 0)
+		return 0;
+	max_out = *(pcl + *pout);
+	for (j = 1; j < nout; j++)
+		if (*(pcl + *(pout + j)) > max_out)
+			max_out = *(pcl + *(pout + j));
+	min_in = *(pcl + *pin);
+	for (i = 1; i < nin; i++)
+		if (*(pcl + *(pin + i)) < min_in)
+			min_in = *(pcl + *(pin + i));
+	if (nout < pst->out_count)
+		bound = *(pcl + *pout) - min_in;
+	if (nin < pst->in_count && max_out - *(pcl + *pin) > bound)
+		bound = max_out - *(pcl + *pin);
+	bound -= pst->wmin;
+	*best = -INFINITY;
+	for (i = 0; i < nin; i++) {
+		k = *(pin + i);
+		rowk = weight_row(pweight, k, pst->wbuf);
+		mask_pairs(pst, k, pmask);
+		for (j = 0; j < nout; j++) {
+			m = *(pout + j);
+			if (*(pmask + m) > 0) {
+				STAT_ADD(pst, blocked, 1);
+				continue;
+			}
+			del = *(pcl + m) - *(pcl + k) - *(rowk + m);
+			if (del > *best) {
+				*best = del;
+				*ind1 = k;
+				*ind2 = m;
+				found = 1;
+			}
+		}
+		unmask_pairs(pst, pmask);
+	}
+	if (found == 0 || *best < bound) {
+		*it += (long) nin * nout;
+		return 0;
+	}
+	*it += (long) pst->in_count * pst->out_count - pst->pair_count;
+	return sol_value + *best > limit ? 2 : 1;
+}
+
+/* Parallel steps of tabu_search, used when pst->par is set. Each scan
+ is split into pst->part_count parts over consecutive list entries; a
+ part keeps its own first best move in pst->parts, and tabu_search
+ combines the parts in list order, which gives the move (and the count
+ of evaluated moves) of the sequential scan. */
+typedef struct
+     {SearchState *pst;
+      Weights *pweight;
+      int size;
+      const int *list;    /* vertices scanned                                 */
+      int count;          /* their number                                     */
+      double sign;        /* 1 - add scan, -1 - drop scan                     */
+      long iter;          /* current iteration                                */
+      double sol_value;
+      double limit;       /* value an aspirating move has to exceed           */
+      const double *row1; /* gain update: row of the vertex moved (out)       */
+      const double *row2; /* gain update: row of the vertex moved in, or NULL */
+      int sub;            /* gain update: 1 if row1 leaves without row2       */
+     }ScanJob;
+
+static void scan_part(void *ctx, int part) {
+	ScanJob *pj = (ScanJob *) ctx;
+	ScanPart *pp = pj->pst->parts + part;
+	int j, k;
+	int lo = (long) pj->count * part / pj->pst->part_count;
+	int hi = (long) pj->count * (part + 1) / pj->pst->part_count;
+	long *pt = pj->pst->t;
+	double d;
+
+	pp->asp = 0;
+	pp->pos = -1;
+	pp->best = -INFINITY;
+	pp->evaluated = 0;
+	pp->blocked = 0;
+	for (j = lo; j < hi; j++) {
+		k = *(pj->list + j);
+		if (*(pt + k) >= pj->iter) {
+			(pp->blocked)++;
+			continue;
+		}
+		(pp->evaluated)++;
+		d = pj->sign * *(pj->pst->cl + k);
+		if (pj->sol_value + d > pj->limit) {
+			pp->asp = 1;
+			pp->pos = k;
+			pp->best = d;
+			return;
+		}
+		if (d > pp->best) {
+			pp->best = d;
+			pp->pos = k;
+		}
+	}
+}
+
+/* Unlike the add and drop scans, the swap scan does not stop at an
+ aspirating move: it looks for the best swap, which tabu_search checks
+ for aspiration once the parts are combined. A part reports its first
+ best swap and never sets asp. */
+static void swap_part(void *ctx, int part) {
+	ScanJob *pj = (ScanJob *) ctx;
+	SearchState *pst = pj->pst;
+	ScanPart *pp = pst->parts + part;
+	int j, k, m;
+	int lo = (long) pj->count * part / pst->part_count;
+	int hi = (long) pj->count * (part + 1) / pst->part_count;
+	double del;
+	double *rowk;
+
+	pp->asp = 0;
+	pp->pos = -1;
+	pp->best = -INFINITY;
+	pp->evaluated = 0;
+	pp->blocked = 0;
+	for (j = lo; j < hi; j++) {
+		k = *(pj->list + j);
+		rowk = weight_row(pj->pweight, k, pp->wbuf);
+		pp->blocked += mask_pairs(pst, k, pp->mask);
+		m = swap_scan(pst->clout, rowk, pp->mask, pj->size, *(pst->cl + k),
+				&del, &pp->evaluated);
+		unmask_pairs(pst, pp->mask);
+		if (m > 0 && del > pp->best) {
+			pp->best = del;
+			pp->pos = k;
+			pp->pos2 = m;
+		}
+	}
+}
+
+static void gain_part(void *ctx, int part) {
+	ScanJob *pj = (ScanJob *) ctx;
+	double *pcl = pj->pst->cl;
+	int lo = 1 + (long) pj->size * part / pj->pst->part_count;
+	int hi = (long) pj->size * (part + 1) / pj->pst->part_count;
+
+	if (lo > hi)
+		return;
+	if (pj->row2 != NULL)
+		gain_swap_part(pcl, pj->row1, pj->row2, lo, hi, FUSED_GAIN_UPDATE);
+	else if (pj->sub)
+		gain_sub_part(pcl, pj->row1, lo, hi);
+	else
+		gain_add_part(pcl, pj->row1, lo, hi);
+}
+
+/* gain_add/gain_sub/gain_swap split across the threads of pst->par. */
+void gain_update_par(int size, const double *row1, const double *row2,
+		int sub, int ind1, int ind2, SearchState *pst) {
+	ScanJob job;
+	double *pcl = pst->cl;
+	double keep1 = *(pcl + ind1), keep2 = 0.;
+
+	if (row2 != NULL)
+		keep2 = *(pcl + ind2);
+	job.pst = pst;
+	job.size = size;
+	job.row1 = row1;
+	job.row2 = row2;
+	job.sub = sub;
+	par_run(pst->par, gain_part, &job, pst->part_count);
+	if (row2 != NULL) {
+		*(pcl + ind1) = keep1 + *(row2 + ind1);
+		*(pcl + ind2) = keep2 - *(row1 + ind2);
+	} else
+		*(pcl + ind1) = keep1;
+}
+
 double tabu_search(int size, int b1, int b2, int keep_tabu_time1,
-		int keep_tabu_time2, int start, long time_limit, long it_bound,
-		double sol_value, int *cl_size, int *vert1, int *vert2, int *stop_cond,
-		int *time_values_opt, double *best_value, clock_t start_time,
-		double **pweight, int **ptabu, Solution *psol) {
-	int i, j, k, k1, k2, m;
-	int ind1, ind2, imp;
-	int tl_ln = 0;
+		int keep_tabu_time2, int start, long it_bound, double sol_value,
+		int *cl_size, int *stop_cond, double *best_value, Budget *pb,
+		Weights *pweight, SearchState *pst) {
+	int i, j, k, m, r;
+	int ind1, ind2, imp, restricted;
+	int *psol = pst->sol, *pbest = pst->best_sol;
+	int *pin = pst->in_list, *pout = pst->out_list;
+	int *pmask = pst->pair_mask;
+	long iter;
+	long *pt = pst->t;
+	TabuPair *pair;
 	long it = 0;
-	long elapsed_time;
+	long moves = 0;
 	double best_improvement;
-	double del;
-	clock_t end;
+	double del, limit;
+	double *pcl = pst->cl, *clout = pst->clout, *wbuf = pst->wbuf;
+	double *row1, *row2, *rowk;
+	ScanJob job;
+	ScanPart *part;
+	STAT_TIMER(t_start);
+	STAT_TIMER(t0);
 
-	for (i = 1; i <= size; i++) {
-		(psol + i)->t = 0;
-		(psol + i)->cl = 0.;
-	}
-	for (i = 1; i < size; i++)
-		for (j = i + 1; j <= size; j++) {
-			tabu(i,j) = 0;
-			tabu(j,i) = 0;
-			if ((psol + i)->sol == 1)
-				(psol + j)->cl += (weight(i,j));
-			if ((psol + j)->sol == 1)
-				(psol + i)->cl += (weight(i,j));
-		}
+	job.pst = pst;
+	job.pweight = pweight;
+	job.size = size;
+	/* forget the tabu state of the previous run: every tenure recorded
+	 so far ends before the new first iteration */
+	pst->iter += (keep_tabu_time1 > keep_tabu_time2 ?
+			keep_tabu_time1 : keep_tabu_time2) + 1;
+	pst->pair_count = 0;
+#if GAIN_VERIFY
+	sol_value = verify_gains(size, sol_value, pweight, pst);
+#endif
 	while (it < it_bound) {
+		iter = ++(pst->iter);
+		while (pst->pair_count > 0
+				&& (pst->pairs + pst->pair_first)->until < iter) {
+			pst->pair_first = (pst->pair_first + 1) % (TABU_TIME2 + 1);
+			(pst->pair_count)--;
+		}
 		ind1 = ind2 = -1;
 		imp = 0;
-		best_improvement = NEG_LARGE_LONG;
-		if (*cl_size < b2)
-			for (k = 1; k <= size; k++) {
-				if ((psol + k)->t > 0 || (psol + k)->sol == 1)
+		best_improvement = -INFINITY;
+		if (pst->par != NULL) {
+			job.iter = iter;
+			job.sol_value = sol_value;
+			job.limit = *best_value + 0.00001;
+		}
+		if (*cl_size < b2 && pst->par != NULL) {
+			job.list = pout;
+			job.count = pst->out_count;
+			job.sign = 1.;
+			par_run(pst->par, scan_part, &job, pst->part_count);
+			for (r = 0; r < pst->part_count; r++) {
+				part = pst->parts + r;
+				it += part->evaluated;
+				STAT_ADD(pst, blocked, part->blocked);
+				if (part->asp) {
+					best_improvement = part->best;
+					ind1 = part->pos;
+					imp = 1;
+					break;
+				}
+				if (part->pos > 0 && part->best > best_improvement) {
+					best_improvement = part->best;
+					ind1 = part->pos;
+				}
+			}
+		} else if (*cl_size < b2)
+			for (j = 0; j < pst->out_count; j++) {
+				k = *(pout + j);
+				if (*(pt + k) >= iter) {
+					STAT_ADD(pst, blocked, 1);
 					continue;
+				}
 				it++;
-				if (sol_value + (psol + k)->cl > *best_value + 0.00001) {
-					best_improvement = (psol + k)->cl;
+				if (sol_value + *(pcl + k) > *best_value + 0.00001) {
+					best_improvement = *(pcl + k);
 					ind1 = k;
 					imp = 1;
 					break;
 				}
-				if ((psol + k)->cl > best_improvement) {
-					best_improvement = (psol + k)->cl;
+				if (*(pcl + k) > best_improvement) {
+					best_improvement = *(pcl + k);
 					ind1 = k;
 				}
 			}
-		if (*cl_size > b1 && imp == 0)
-			for (k = 1; k <= size; k++) {
-				if ((psol + k)->t > 0 || (psol + k)->sol == 0)
+		if (*cl_size > b1 && imp == 0 && pst->par != NULL) {
+			job.list = pin;
+			job.count = pst->in_count;
+			job.sign = -1.;
+			par_run(pst->par, scan_part, &job, pst->part_count);
+			for (r = 0; r < pst->part_count; r++) {
+				part = pst->parts + r;
+				it += part->evaluated;
+				STAT_ADD(pst, blocked, part->blocked);
+				if (part->asp) {
+					best_improvement = part->best;
+					ind1 = part->pos;
+					imp = 2;
+					break;
+				}
+				if (part->pos > 0 && part->best > best_improvement) {
+					best_improvement = part->best;
+					ind1 = part->pos;
+				}
+			}
+		} else if (*cl_size > b1 && imp == 0)
+			for (j = 0; j < pst->in_count; j++) {
+				k = *(pin + j);
+				if (*(pt + k) >= iter) {
+					STAT_ADD(pst, blocked, 1);
 					continue;
+				}
 				it++;
-				if (sol_value - (psol + k)->cl > *best_value + 0.00001) {
-					best_improvement = -(psol + k)->cl;
+				if (sol_value - *(pcl + k) > *best_value + 0.00001) {
+					best_improvement = -*(pcl + k);
 					ind1 = k;
 					imp = 2;
 					break;
 				}
-				if (-(psol + k)->cl > best_improvement) {
-					best_improvement = -(psol + k)->cl;
+				if (-*(pcl + k) > best_improvement) {
+					best_improvement = -*(pcl + k);
 					ind1 = k;
 				}
 			}
-		if ((*cl_size == b1 || *cl_size == b2) && imp == 0)
-			for (k = 1; k <= size; k++) {
-				if ((psol + k)->sol == 0)
-					continue;
-				for (m = 1; m <= size; m++) {
-					if ((psol + m)->sol == 1 || tabu(k,m) > 0)
-						continue;
-					it++;
-					del = (psol + m)->cl - (psol + k)->cl - weight(k,m);
-					if (sol_value + del > *best_value + 0.00001) {
-						best_improvement = del;
-						ind1 = k;
-						ind2 = m;
+		if ((*cl_size == b1 || *cl_size == b2) && imp == 0) {
+			limit = *best_value + 0.00001;
+			restricted = 0;
+			if (pweight->kind == WEIGHTS_SPARSE) {
+				/* complete: never followed by the full scan */
+				restricted = swap_sparse(sol_value, limit, 1, &it, pweight,
+						pst, &k, &m, &del);
+				if (restricted == 0) {
+					restricted = 1;
+					del = -INFINITY;
+				}
+				if (restricted == 2 || del > best_improvement) {
+					best_improvement = del;
+					ind1 = k;
+					ind2 = m;
+					if (restricted == 2)
 						imp = 3;
-						break;
+				}
+			} else if (pst->rcl_size > 0) {
+				restricted = swap_restricted(size, sol_value, limit, &it,
+						pweight, pst, &k, &m, &del);
+				if (restricted == 2 || (restricted == 1
+						&& del > best_improvement)) {
+					best_improvement = del;
+					ind1 = k;
+					ind2 = m;
+					if (restricted == 2)
+						imp = 3;
+				}
+			}
+			if (restricted == 0) {
+				for (j = 0; j < pst->out_count; j++)
+					*(clout + *(pout + j)) = *(pcl + *(pout + j));
+				for (j = 0; j < pst->in_count; j++)
+					*(clout + *(pin + j)) = -INFINITY;
+			}
+			if (restricted == 0 && pst->par != NULL) {
+				job.list = pin;
+				job.count = pst->in_count;
+				par_run(pst->par, swap_part, &job, pst->part_count);
+				for (r = 0; r < pst->part_count; r++) {
+					part = pst->parts + r;
+					it += part->evaluated;
+					STAT_ADD(pst, blocked, part->blocked);
+					if (part->pos > 0 && part->best > best_improvement) {
+						best_improvement = part->best;
+						ind1 = part->pos;
+						ind2 = part->pos2;
 					}
-					if (del > best_improvement) {
+				}
+			} else if (restricted == 0)
+				for (j = 0; j < pst->in_count; j++) {
+					k = *(pin + j);
+					rowk = weight_row(pweight, k, wbuf);
+					r = mask_pairs(pst, k, pmask);
+					STAT_ADD(pst, blocked, r);
+					m = swap_scan(clout, rowk, pmask, size, *(pcl + k), &del,
+							&it);
+					unmask_pairs(pst, pmask);
+					if (m > 0 && del > best_improvement) {
 						best_improvement = del;
 						ind1 = k;
 						ind2 = m;
 					}
 				}
+			/* the full scan takes the best swap, as swap_restricted does,
+			 and it aspirates if that one does */
+			if (restricted == 0 && ind2 > 0
+					&& sol_value + best_improvement > limit)
+				imp = 3;
+		}
+		if (ind1 == -1) {
+			/* no move was evaluated: either there is none, as with |S|=b1
+			 and no vertex out of S, and the run is over, or all of them
+			 are tabu and the iteration is spent waiting for the tenures
+			 to run out */
+			if (pst->out_count == 0 && *cl_size <= b1) {
+				*stop_cond = 1;
+				break;
+			}
+			if (budget_tick(pb)) {
+				*stop_cond = 1;
+				break;
 			}
+			continue;
+		}
+		row1 = pweight->kind == WEIGHTS_SPARSE ? NULL
+				: weight_row(pweight, ind1, wbuf);
 		if (ind2 == -1) {
-			if ((psol + ind1)->sol == 1) {
-				for (j = 1; j <= size; j++)
-					if (j != ind1)
-						(psol + j)->cl -= (weight(j,ind1));
+			if (*(psol + ind1) == 1) {
+				if (row1 == NULL)
+					sparse_gain(pweight, pcl, ind1, -1.);
+				else if (pst->par != NULL)
+					gain_update_par(size, row1, NULL, 1, ind1, -1, pst);
+				else
+					gain_sub(pcl, row1, size, ind1);
+				move_out(ind1, pst);
 				(*cl_size)--;
+				STAT_ADD(pst, drops, 1);
 			} else {
-				for (j = 1; j <= size; j++)
-					if (j != ind1)
-						(psol + j)->cl += (weight(j,ind1));
+				if (row1 == NULL)
+					sparse_gain(pweight, pcl, ind1, 1.);
+				else if (pst->par != NULL)
+					gain_update_par(size, row1, NULL, 0, ind1, -1, pst);
+				else
+					gain_add(pcl, row1, size, ind1);
+				move_in(ind1, pst);
 				(*cl_size)++;
+				STAT_ADD(pst, adds, 1);
 			}
-			(psol + ind1)->sol = 1 - (psol + ind1)->sol;
 			sol_value += best_improvement;
 		} else {
-			for (j = 1; j <= size; j++) {
-				if (j != ind1)
-					(psol + j)->cl -= (weight(j,ind1));
-				if (j != ind2)
-					(psol + j)->cl += (weight(j,ind2));
-			}
-			(psol + ind1)->sol = 0;
-			(psol + ind2)->sol = 1;
+			if (row1 == NULL) {
+				sparse_gain(pweight, pcl, ind1, -1.);
+				sparse_gain(pweight, pcl, ind2, 1.);
+			} else {
+				row2 = weight_row(pweight, ind2, wbuf + size + 1);
+				if (pst->par != NULL)
+					gain_update_par(size, row1, row2, 0, ind1, ind2, pst);
+				else
+					gain_swap(pcl, row1, row2, size, ind1, ind2,
+							FUSED_GAIN_UPDATE);
+			}
+			move_out(ind1, pst);
+			move_in(ind2, pst);
 			sol_value += best_improvement;
+			STAT_ADD(pst, swaps, 1);
 		}
+		if ((pweight->kind == WEIGHTS_PACKED_FLOAT
+				|| pweight->kind == WEIGHTS_PACKED_DOUBLE)
+				&& ++moves % GAIN_RESYNC_PERIOD == 0)
+			sol_value = compute_gains(size, pweight, pst);
 		if (imp > 0) {
+			STAT_ADD(pst, aspirations, 1);
+			STAT_RESET(t0);
 			sol_value += local_search(size, b1, b2, cl_size, &it, pweight,
-					psol);
+					pst);
+			STAT_TIME(pst, ms_local, t0);
 			for (i = 1; i <= size; i++)
-				(psol + i)->best_sol = (psol + i)->sol;
+				*(pbest + i) = *(psol + i);
 			*best_value = sol_value;
-			((psol + 1)->performance)++;
-			(psol + 3)->performance = start;
-			take_time(time_values_opt, start_time);
-		}
-		for (i = 1; i <= size; i++)
-			if ((psol + i)->t > 0)
-				((psol + i)->t)--;
-		m = -1;
-		for (i = 1; i <= tl_ln; i++) {
-			k1 = *(vert1 + i);
-			k2 = *(vert2 + i);
-			(tabu(k1,k2))--;
-			(tabu(k2,k1))--;
-			if (tabu(k1,k2) == 0)
-				m = i;
-		}
-		if (m > 0) {
-			for (i = m; i < tl_ln; i++) {
-				*(vert1 + i) = *(vert1 + i + 1);
-				*(vert2 + i) = *(vert2 + i + 1);
-			}
-			tl_ln--;
+			(pst->stats.improvements)++;
+			pst->stats.last_start = start;
+			pst->stats.time_to_opt = budget_elapsed(pb);
+			trace_add(&pst->trace, pst->stats.time_to_opt * 1000.,
+					pb->iterations, start, sol_value);
+			if (budget_value(pb, sol_value)) {
+				*stop_cond = 1;
+				break;
+			}
 		}
 		if (ind2 == -1)
-			(psol + ind1)->t = keep_tabu_time1;
+			*(pt + ind1) = iter + keep_tabu_time1;
 		else {
-			tl_ln++;
-			*(vert1 + tl_ln) = ind1;
-			*(vert2 + tl_ln) = ind2;
-			tabu(ind1,ind2) = keep_tabu_time2;
-			tabu(ind2,ind1) = keep_tabu_time2;
-		}
-		end = clock();
-		elapsed_time = (long) (end - start_time) / CLK_TCK;
-		if (elapsed_time >= time_limit) {
+			pair = pst->pairs
+					+ (pst->pair_first + pst->pair_count) % (TABU_TIME2 + 1);
+			pair->k = ind1;
+			pair->m = ind2;
+			pair->until = iter + keep_tabu_time2;
+			(pst->pair_count)++;
+		}
+		if (budget_tick(pb)) {
 			*stop_cond = 1;
 			break;
 		}
 	}
+	STAT_ADD(pst, evaluated, it);
+	STAT_TIME(pst, ms_tabu, t_start);
 	return sol_value;
 }
 
-double ITS_internal(FILE *out, int size, int b1, int b2, long time_limit,
+/* prng[0] gives the initial solution, prng[1] the perturbation moves and
+ prng[2] their number and the solutions taken from the elite pool. */
+double ITS_internal(int size, int b1, int b2,
 		int keep_tabu_time1, int keep_tabu_time2, int perturb_count,
-		int min_perturb_count, int cand_list_size, long it_bound, int *vert1,
-		int *vert2, int *time_values_opt, double *seed1, clock_t start,
-		double **pweight, int **ptabu, Solution *psol) {
+		int min_perturb_count, int cand_list_size, long it_bound,
+		Rng *prng, Budget *pb, Weights *pweight, SearchState *pst,
+		ElitePool *pe) {
 	int i;
+	int *psol = pst->sol, *pbest = pst->best_sol;
 	int st = 1;
 	int cl_size;
 	int stop_cond = 0;
 	double sol_value, best_value;
-	double seed2, seed3, coef;
-
-	coef = 2048;
-	coef *= 1024;
-	coef *= 1024;
-	coef -= 1;
-	seed2 = 2 * (*seed1);
-	seed3 = 3 * (*seed1);
-	(psol + 1)->performance = 0;
-	(psol + 2)->performance = 0;
+	double published = -INFINITY;
+	STAT_TIMER(t0);
+	pst->stats.improvements = 0;
+	pst->stats.last_start = 0;
+	pst->stats.ls_moves = 0;
+	pst->stats.gain_drift = 0.;
+	pst->stats.value_drift = 0.;
+	pst->stats.evaluated = 0;
+	pst->stats.adds = pst->stats.drops = pst->stats.swaps = 0;
+	pst->stats.blocked = pst->stats.aspirations = 0;
+	pst->stats.ms_start = pst->stats.ms_tabu = 0.;
+	pst->stats.ms_local = pst->stats.ms_perturb = 0.;
 
 	if (size > 200)
-		sol_value = random_start(size, b1, b2, &cl_size, coef, seed1, pweight,
-				psol);
+		sol_value = random_start(size, b1, b2, &cl_size, prng, pweight, pst);
 	else
-		sol_value = steepest_ascent(out, size, b1, b2, &cl_size, coef, seed1,
-				pweight, psol);
+		sol_value = steepest_ascent(size, b1, b2, &cl_size, prng, pweight, pst);
+	if (pst->status != ITS_OK)
+		return -INFINITY;
 //fprintf(out,"*****Steepest ascent*****   sol_value=%8ld  cl_size=%4d\n",
 //sol_value,cl_size);
+	build_lists(size, pst);
+	compute_gains(size, pweight, pst);
+	STAT_TIME(pst, ms_start, t0);
 	best_value = sol_value;
 	for (i = 1; i <= size; i++)
-		(psol + i)->best_sol = (psol + i)->sol;
-	sol_value = tabu_search(size, b1, b2, keep_tabu_time1, keep_tabu_time2, st,
-			time_limit, it_bound, sol_value, &cl_size, vert1, vert2, &stop_cond,
-			time_values_opt, &best_value, start, pweight, ptabu, psol);
+		*(pbest + i) = *(psol + i);
+	pst->stats.time_to_opt = budget_elapsed(pb);
+	trace_add(&pst->trace, pst->stats.time_to_opt * 1000., pb->iterations, st,
+			best_value);
+	stop_cond = budget_value(pb, best_value);
+	if (stop_cond == 0)
+		sol_value = tabu_search(size, b1, b2, keep_tabu_time1, keep_tabu_time2,
+				st, it_bound, sol_value, &cl_size, &stop_cond, &best_value, pb,
+				pweight, pst);
 	if (perturb_count > b1)
 		perturb_count = b1;
 	while (stop_cond == 0) {
 		st++;
+		if (pe != NULL) {
+			if (best_value > published) {
+				elite_offer(pe, pbest, best_value);
+				published = best_value;
+			}
+			if (st % ELITE_PERIOD == 0 && elite_best(pe) > best_value) {
+				elite_pick(pe, psol, prng + 2);
+				build_lists(size, pst);
+				cl_size = pst->in_count;
+				sol_value = compute_gains(size, pweight, pst);
+			}
+		}
 		if (perturb_count <= min_perturb_count)
 			i = perturb_count;
 		else {
-			i = random(&seed3, coef) * (perturb_count - min_perturb_count + 1);
+			i = rng_next(prng + 2) * (perturb_count - min_perturb_count + 1);
 			i += min_perturb_count;
 		}
+		STAT_RESET(t0);
 		sol_value = get_solution(size, b1, b2, i, cand_list_size, sol_value,
-				&cl_size, coef, &seed2, pweight, psol);
+				&cl_size, prng + 1, pweight, pst);
+		STAT_TIME(pst, ms_perturb, t0);
 		sol_value = tabu_search(size, b1, b2, keep_tabu_time1, keep_tabu_time2,
-				st, time_limit, it_bound, sol_value, &cl_size, vert1, vert2,
-				&stop_cond, time_values_opt, &best_value, start, pweight, ptabu,
-				psol);
+				st, it_bound, sol_value, &cl_size, &stop_cond, &best_value, pb,
+				pweight, pst);
 	}
-	(psol + 5)->performance = st;
+	pst->stats.starts = st;
 	return best_value;
 }
 
-void ITS(char *in_file_name, char *out_file_name, int b1, int b2, double seed,
+/* Returns ITS_OK or ITS_ERR_MEMORY; the state is to be freed by
+ free_state() either way. */
+int alloc_state(int size, SearchState *pst) {
+	memset(pst, 0, sizeof(SearchState));
+	pst->status = ITS_OK;
+	ALR(pst->sol, int, size+1)
+	ALR(pst->best_sol, int, size+1)
+	ALR(pst->t, long, size+1)
+	ALR(pst->pair_mask, int, size+1)
+	ALR(pst->pairs, TabuPair, TABU_TIME2+1)
+	ALR(pst->val, int, size+1)
+	ALR(pst->perm, int, size+1)
+	ALR(pst->in_list, int, size+1)
+	ALR(pst->out_list, int, size+1)
+	ALR(pst->pos, int, size+1)
+	ALRA(pst->cl, double, size+1)
+	ALRA(pst->clout, double, size+1)
+	ALRA(pst->wbuf, double, 2*(size+1))
+	ALR(pst->sf, double, size+1)
+	ALR(pst->s1, double, size+1)
+	ALR(pst->cand.cand1, int, LIST_SIZE+1)
+	ALR(pst->cand.cand2, int, LIST_SIZE+1)
+	ALR(pst->cand.d, double, LIST_SIZE+1)
+	ALR(pst->order, int, 2*(size+1))
+	return trace_alloc(0, &pst->trace);
+}
+
+/* Prepares a state set up by alloc_state() for another run: the search
+ arrays are all rebuilt by ITS_internal(), the tabu times expire at the
+ start of tabu_search since iter is never reset, and the masks are clear
+ between scans. */
+static void reset_state(SearchState *pst) {
+	memset(&pst->stats, 0, sizeof(Stats));
+	trace_clear(&pst->trace);
+	pst->pair_first = pst->pair_count = 0;
+	pst->status = ITS_OK;
+}
+
+/* Scratch of the swap scans in sparse storage (see sparse_top). */
+int alloc_sparse(int size, SearchState *pst) {
+	ALR(pst->mark, int, size+1)
+	ALR(pst->top, int, 2*(size+1))
+	return ITS_OK;
+}
+
+/* Restricts the swap scans of tabu_search and local_search to candidate
+ lists of length rcl_size (see swap_restricted). */
+int alloc_rcl(int size, int rcl_size, SearchState *pst) {
+	if (rcl_size <= 0)
+		return ITS_OK;
+	if (rcl_size > size)
+		rcl_size = size;
+	pst->rcl_size = rcl_size;
+	ALR(pst->rcl_in, int, rcl_size)
+	ALR(pst->rcl_out, int, rcl_size)
+	return ITS_OK;
+}
+
+/* Sets up threads threads (the caller included) for the scans of
+ tabu_search; nothing is done for graphs below PAR_MIN_SIZE. */
+int alloc_par(int size, int threads, SearchState *pst) {
+	int i, status;
+
+	if (threads < 2 || size < PAR_MIN_SIZE)
+		return ITS_OK;
+	ALR(pst->par, ParPool, 1)
+	if ((status = par_init(threads, pst->par)) != ITS_OK)
+		return status;
+	ALR(pst->parts, ScanPart, threads*PAR_PARTS_PER_THREAD)
+	pst->part_count = threads * PAR_PARTS_PER_THREAD;
+	for (i = 0; i < pst->part_count; i++) {
+		ALR((pst->parts + i)->mask, int, size+1)
+		ALRA((pst->parts + i)->wbuf, double, size+1)
+	}
+	return ITS_OK;
+}
+
+int ITS(char *in_file_name, char *out_file_name, int b1, int b2, double seed,
 		long iterations_coef, long time_limit, Results *pres) {
-	FILE *out, *in;
-	double **pweight;
-	int **ptabu;
-	Solution *psol;
-	int *vert1;
-	int *vert2;
+	Limits limits;
 
-	int i, j;
-	int size, cl_size = 0;
+	limits.time_ms = time_limit * 1000.;
+	limits.iterations = 0;
+	limits.target = 0.;
+	limits.has_target = 0;
+	return ITS_storage(in_file_name, out_file_name, b1, b2, seed,
+			iterations_coef, &limits, WEIGHTS_DENSE, pres);
+}
+
+void free_state(SearchState *pst) {
+	int i;
+
+	free(pst->sol);
+	free(pst->best_sol);
+	free(pst->t);
+	free(pst->pair_mask);
+	free(pst->pairs);
+	free(pst->val);
+	free(pst->perm);
+	free(pst->in_list);
+	free(pst->out_list);
+	free(pst->pos);
+	free(pst->cl);
+	free(pst->clout);
+	free(pst->wbuf);
+	free(pst->sf);
+	free(pst->s1);
+	free(pst->cand.cand1);
+	free(pst->cand.cand2);
+	free(pst->cand.d);
+	free(pst->order);
+	free(pst->rcl_in);
+	free(pst->rcl_out);
+	free(pst->mark);
+	free(pst->top);
+	trace_free(&pst->trace);
+	if (pst->par != NULL) {
+		par_free(pst->par);
+		free(pst->par);
+		for (i = 0; i < pst->part_count; i++) {
+			free((pst->parts + i)->mask);
+			free((pst->parts + i)->wbuf);
+		}
+		free(pst->parts);
+	}
+}
+
+static void put_triplet(void *ctx, int i, int j, double w) {
+	put_weight((Weights *) ctx, i + 1, j + 1, w);
+}
+
+/* Sparse storage is read in two passes over the triplets: the first
+ counts the nonzero weights of each vertex into xadj[v+1], the second
+ places every edge in the lists of both its ends, at positions taken
+ from fill. Both sinks are called from several threads. */
+typedef struct
+     {Weights *pweight;
+      long *fill;         /* next free position in the list of each vertex    */
+     }SparseFill;
+
+static void count_triplet(void *ctx, int i, int j, double w) {
+	Weights *pweight = ((SparseFill *) ctx)->pweight;
+
+	if (w == 0.)
+		return;
+	__atomic_fetch_add(pweight->xadj + i + 2, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(pweight->xadj + j + 2, 1, __ATOMIC_RELAXED);
+}
+
+static void fill_triplet(void *ctx, int i, int j, double w) {
+	Weights *pweight = ((SparseFill *) ctx)->pweight;
+	long *fill = ((SparseFill *) ctx)->fill;
+	long e;
+
+	if (w == 0.)
+		return;
+	e = __atomic_fetch_add(fill + i + 1, 1, __ATOMIC_RELAXED);
+	*(pweight->adj + e) = j + 1;
+	*(pweight->adjw + e) = w;
+	e = __atomic_fetch_add(fill + j + 1, 1, __ATOMIC_RELAXED);
+	*(pweight->adj + e) = i + 1;
+	*(pweight->adjw + e) = w;
+}
+
+typedef struct
+     {int v;
+      double w;
+     }SparseEdge;
+
+static int edge_compare(const void *a, const void *b) {
+	int u = ((const SparseEdge *) a)->v, v = ((const SparseEdge *) b)->v;
+
+	return u < v ? -1 : u > v;
+}
+
+/* Reads a text instance into sparse storage, with up to threads threads.
+ The lists come out of the second pass in no particular order; they are
+ sorted, for sparse_weight(), and a pair given twice keeps one of its
+ weights. Returns ITS_OK or an error. */
+static int load_sparse(TripletFile *pf, int threads, Weights *pweight) {
+	SparseFill ctx;
+	SparseEdge *edges;
+	int i, size = pweight->size;
+	long e, d, q, max = 0;
+
+	ALR(pweight->xadj, long, size+2)
+	ctx.pweight = pweight;
+	if (triplets_read(pf, threads, count_triplet, &ctx) < 0)
+		return ITS_ERR_FORMAT;
+	for (i = 1; i <= size; i++) {
+		d = *(pweight->xadj + i + 1);
+		if (d > max)
+			max = d;
+		*(pweight->xadj + i + 1) += *(pweight->xadj + i);
+	}
+	e = *(pweight->xadj + size + 1);
+	ALR(pweight->adj, int, e+1)
+	ALR(pweight->adjw, double, e+1)
+	ALR(ctx.fill, long, size+2)
+	memcpy(ctx.fill, pweight->xadj, (size + 2) * sizeof(long));
+	if (triplets_read(pf, threads, fill_triplet, &ctx) < 0) {
+		free(ctx.fill);
+		return ITS_ERR_FORMAT;
+	}
+	free(ctx.fill);
+	ALR(edges, SparseEdge, max+1)
+	q = 0;
+	for (i = 1; i <= size; i++) {
+		d = 0;
+		for (e = *(pweight->xadj + i); e < *(pweight->xadj + i + 1); e++) {
+			(edges + d)->v = *(pweight->adj + e);
+			(edges + d++)->w = *(pweight->adjw + e);
+		}
+		qsort(edges, d, sizeof(SparseEdge), edge_compare);
+		*(pweight->xadj + i) = q;
+		for (e = 0; e < d; e++) {
+			if (e > 0 && (edges + e)->v == (edges + e - 1)->v)
+				continue;
+			*(pweight->adj + q) = (edges + e)->v;
+			*(pweight->adjw + q++) = (edges + e)->w;
+		}
+	}
+	*(pweight->xadj + size + 1) = q;
+	free(edges);
+	return ITS_OK;
+}
+
+/* Points *pweight to the payload of the binary instance in
+ pweight->file; returns 0 if the payload fits the header. */
+static int load_binary(Weights *pweight) {
+	BinaryHeader *ph = &pweight->file.header;
+	long e_count = ((long) ph->size) * (ph->size - 1) / 2;
+	long bytes;
+
+	pweight->kind = ph->kind;
+	pweight->size = ph->size;
+	pweight->stride = ph->stride;
+	pweight->w = NULL;
+	pweight->wf = NULL;
+	pweight->xadj = NULL;
+	pweight->adj = NULL;
+	pweight->adjw = NULL;
+	pweight->dim = 0;
+	if (ph->kind == WEIGHTS_DENSE) {
+		if (ph->stride <= ph->size
+				|| ph->stride % (WEIGHT_ALIGN / sizeof(double)) != 0)
+			return -1;
+		bytes = (ph->size + 1) * ph->stride * sizeof(double);
+		pweight->w = (double *) pweight->file.payload;
+	} else if (ph->kind == WEIGHTS_PACKED_FLOAT) {
+		bytes = e_count * sizeof(float);
+		pweight->wf = (float *) pweight->file.payload;
+	} else if (ph->kind == WEIGHTS_PACKED_DOUBLE) {
+		bytes = e_count * sizeof(double);
+		pweight->w = (double *) pweight->file.payload;
+	} else
+		return -1;
+	return bytes == ph->bytes ? 0 : -1;
+}
+
+/* Smallest weight of the instance, which bounds the gains of swaps. */
+static double min_weight(const Weights *pweight) {
+	int i, j, size = pweight->size;
+	long e;
+	double wmin = INFINITY;
+
+	if (pweight->kind == WEIGHTS_POINTS)
+		return 0.; /* a distance is never negative */
+	if (pweight->kind == WEIGHTS_SPARSE) {
+		/* a pair missing from the lists weighs 0 */
+		e = *(pweight->xadj + size + 1);
+		if (e < (long) size * (size - 1))
+			wmin = 0.;
+		while (--e >= 0)
+			if (*(pweight->adjw + e) < wmin)
+				wmin = *(pweight->adjw + e);
+		return wmin;
+	}
+	for (i = 1; i < size; i++)
+		for (j = i + 1; j <= size; j++)
+			if (weight(i,j) < wmin)
+				wmin = weight(i,j);
+	return wmin;
+}
+
+/* Allocates the weights of a text instance in the storage kind and of
+ the order and dimension set in *pweight, and sets its stride. */
+static int alloc_storage(Weights *pweight) {
+	int a = WEIGHT_ALIGN / sizeof(double), size = pweight->size;
+	long e_count = ((long) size) * (size - 1) / 2;
+
+	pweight->stride = 0;
+	if (pweight->kind == WEIGHTS_DENSE || pweight->kind == WEIGHTS_POINTS)
+		pweight->stride = (size + 1 + a - 1) / a * a;
+	if (pweight->kind == WEIGHTS_DENSE) {
+		ALRA(pweight->w, double, (size+1)*pweight->stride)
+	} else if (pweight->kind == WEIGHTS_POINTS) {
+		ALRA(pweight->w, double, pweight->dim*pweight->stride)
+	} else if (pweight->kind == WEIGHTS_PACKED_FLOAT) {
+		ALRA(pweight->wf, float, e_count)
+	} else {
+		ALRA(pweight->w, double, e_count)
+	}
+	return ITS_OK;
+}
+
+/* Reads an instance into *pweight, stored as given by storage, parsing
+ it with up to threads threads (see 'loader.h'). A binary instance is
+ mapped instead and keeps the storage it was written with. The weights
+ are only read afterwards, so one instance can be shared by several
+ ITS_run() calls executing at the same time. Returns ITS_OK, or an error
+ with nothing left to free. */
+int ITS_load(const char *in_file_name, int storage, int threads,
+		Weights *pweight) {
+	TripletFile file;
+	int i;
+	int status;
+
+	pweight->file.map = NULL;
+	i = binary_open(in_file_name, &pweight->file);
+	if (i < 0)
+		return ITS_ERR_FORMAT;
+	if (i == 0) {
+		if (load_binary(pweight) != 0) {
+			binary_close(&pweight->file);
+			return ITS_ERR_FORMAT;
+		}
+		pweight->wmin = min_weight(pweight);
+		return ITS_OK;
+	}
+	if (triplets_open(in_file_name, &file) != 0)
+		return ITS_ERR_OPEN;
+	pweight->kind = storage;
+	pweight->size = file.size;
+	pweight->w = NULL;
+	pweight->wf = NULL;
+	pweight->xadj = NULL;
+	pweight->adj = NULL;
+	pweight->adjw = NULL;
+	pweight->dim = 0;
+	pweight->stride = 0;
+	if (storage == WEIGHTS_SPARSE)
+		status = load_sparse(&file, threads, pweight);
+	else if (storage == WEIGHTS_POINTS) {
+		/* a point file: the second number of the header is the dimension */
+		pweight->dim = file.second;
+		if (pweight->dim < 1)
+			status = ITS_ERR_FORMAT;
+		else if ((status = alloc_storage(pweight)) == ITS_OK
+				&& points_read(&file, pweight->dim, pweight->w,
+						pweight->stride) < 0)
+			status = ITS_ERR_FORMAT;
+	} else if ((status = alloc_storage(pweight)) == ITS_OK
+			&& triplets_read(&file, threads, put_triplet, pweight) < 0)
+		status = ITS_ERR_FORMAT;
+	triplets_close(&file);
+	if (status != ITS_OK) {
+		free_weights(pweight);
+		return status;
+	}
+	pweight->wmin = min_weight(pweight);
+	return ITS_OK;
+}
+
+void free_weights(Weights *pweight) {
+	if (pweight->file.map != NULL)
+		binary_close(&pweight->file);
+	else {
+		free(pweight->w);
+		free(pweight->wf);
+		free(pweight->xadj);
+		free(pweight->adj);
+		free(pweight->adjw);
+	}
+	pweight->w = NULL;
+	pweight->wf = NULL;
+	pweight->xadj = NULL;
+	pweight->adj = NULL;
+	pweight->adjw = NULL;
+}
+
+int ITS_storage(char *in_file_name, char *out_file_name, int b1, int b2,
+		double seed, long iterations_coef, const Limits *plimits, int storage,
+		Results *pres) {
+	Weights weights;
+	int status;
+
+	if ((status = ITS_load(in_file_name, storage, 1, &weights)) != ITS_OK)
+		return status;
+	status = ITS_run(&weights, out_file_name, b1, b2, seed, iterations_coef,
+			plimits, pres);
+	free_weights(&weights);
+	return status;
+}
+
+/* Solves a loaded instance; all search state is private to the call. */
+int ITS_run(Weights *pweight, char *out_file_name, int b1, int b2,
+		double seed, long iterations_coef, const Limits *plimits,
+		Results *pres) {
+	return ITS_coop(pweight, out_file_name, b1, b2, seed, iterations_coef,
+			plimits, 1, 1, 0, RNG_DEFAULT, 0, pres);
+}
+
+/* One of the cooperating runs of ITS_solve(). */
+typedef struct Worker
+     {Weights *pweight;   /* shared instance                                  */
+      ElitePool *pe;      /* shared elite pool, or NULL                       */
+      SearchState state;  /* private search state                             */
+      Budget budget;      /* private budget                                   */
+      Rng rng[3];         /* random number streams of the run                 */
+      double value;       /* best value found                                 */
+      int b1, b2;
+      int keep_tabu_time1;
+      int perturb_count;
+      long it_bound;
+     }Worker;
+
+static void *coop_worker(void *arg) {
+	Worker *pw = (Worker *) arg;
+
+	pw->value = ITS_internal(pw->pweight->size, pw->b1, pw->b2,
+			pw->keep_tabu_time1, TABU_TIME2, pw->perturb_count, MIN_PER_COUNT,
+			LIST_SIZE, pw->it_bound, pw->rng, &pw->budget, pw->pweight,
+			&pw->state, pw->pe);
+	return NULL;
+}
+
+#if ITS_STATS
+/* Writes the counters of the runs to <out_file_name>.json. */
+static void write_stats(const char *out_file_name, const Worker *pworker,
+		int workers, int size, double total_ms) {
+	FILE *f;
+	char file_name[1024];
+	const Stats *ps;
+	int w;
+
+	snprintf(file_name, sizeof(file_name), "%s.json", out_file_name);
+	if ((f = fopen(file_name, "w")) == NULL)
+		return;
+	fprintf(f, "{\"graph_order\": %d, \"total_ms\": %.3lf, \"runs\": [",
+			size, total_ms);
+	for (w = 0; w < workers; w++) {
+		ps = &(pworker + w)->state.stats;
+		fprintf(f, "%s\n  {\"run\": %d, \"value\": %.3lf, \"starts\": %d, "
+				"\"iterations\": %ld, \"evaluated\": %ld, "
+				"\"evaluated_per_s\": %.0lf,\n   \"moves\": {\"add\": %ld, "
+				"\"drop\": %ld, \"swap\": %ld, \"local_search\": %ld}, "
+				"\"tabu_blocked\": %ld, \"aspirations\": %ld,\n   "
+				"\"ms\": {\"construction\": %.3lf, \"tabu_search\": %.3lf, "
+				"\"local_search\": %.3lf, \"get_solution\": %.3lf}}",
+				w > 0 ? "," : "", w, (pworker + w)->value, ps->starts,
+				(pworker + w)->budget.iterations, ps->evaluated,
+				total_ms > 0. ? ps->evaluated / (total_ms / 1000.) : 0.,
+				ps->adds, ps->drops, ps->swaps, ps->ls_moves, ps->blocked,
+				ps->aspirations, ps->ms_start, ps->ms_tabu, ps->ms_local,
+				ps->ms_perturb);
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+}
+#endif
+
+const char *ITS_error(int status) {
+	switch (status) {
+	case ITS_OK:
+		return "no error";
+	case ITS_ERR_MEMORY:
+		return "failure in memory allocation";
+	case ITS_ERR_OPEN:
+		return "fopen failed";
+	case ITS_ERR_FORMAT:
+		return "malformed input file";
+	case ITS_ERR_PARAMS:
+		return "bounds unfit for the graph order";
+	case ITS_ERR_THREAD:
+		return "pthread_create failed";
+	case ITS_ERR_INTERNAL:
+		return "inconsistent solution found";
+	}
+	return "unknown error";
+}
+
+void ITS_solver_init(Solver *ps) {
+	memset(ps, 0, sizeof(Solver));
+}
+
+void ITS_solver_free(Solver *ps) {
+	int w;
+
+	if (ps->pworker != NULL) {
+		for (w = 0; w < ps->workers; w++)
+			free_state(&(ps->pworker + w)->state);
+		free(ps->pworker);
+	}
+	if (ps->pool != NULL) {
+		elite_free(ps->pool);
+		free(ps->pool);
+	}
+	free(ps->threads);
+	ITS_solver_init(ps);
+}
+
+/* Gives *ps the buffers of workers runs over *pweight with the
+ parameters *pp, keeping those it has if they fit. On failure the caller
+ frees the solver. */
+static int solver_setup(Solver *ps, const Weights *pweight,
+		const Params *pp, int workers, int scan_threads) {
+	SearchState *pst;
+	int w, status;
+	int size = pweight->size;
+
+	if (ps->pworker != NULL && ps->size == size
+			&& ps->kind == pweight->kind && ps->workers == workers
+			&& ps->scan_threads == scan_threads
+			&& ps->swap_cand == pp->swap_cand
+			&& ps->trace_size == pp->trace_size) {
+		for (w = 0; w < workers; w++)
+			reset_state(&(ps->pworker + w)->state);
+		if (ps->pool != NULL)
+			elite_clear(ps->pool);
+		return ITS_OK;
+	}
+	ITS_solver_free(ps);
+	ps->size = size;
+	ps->kind = pweight->kind;
+	ps->workers = workers;
+	ps->scan_threads = scan_threads;
+	ps->swap_cand = pp->swap_cand;
+	ps->trace_size = pp->trace_size;
+	ALR(ps->pworker, Worker, workers)
+	ALR(ps->threads, pthread_t, workers)
+	if (workers > 1) {
+		ALR(ps->pool, ElitePool, 1)
+		if ((status = elite_alloc(size, ps->pool)) != ITS_OK)
+			return status;
+	}
+	for (w = 0; w < workers; w++) {
+		pst = &(ps->pworker + w)->state;
+		if ((status = alloc_state(size, pst)) != ITS_OK)
+			return status;
+		if (pweight->kind == WEIGHTS_SPARSE)
+			status = alloc_sparse(size, pst);
+		else if ((status = alloc_par(size, scan_threads, pst)) == ITS_OK)
+			status = alloc_rcl(size, pp->swap_cand, pst);
+		if (status == ITS_OK)
+			status = trace_alloc(pp->trace_size, &pst->trace);
+		if (status != ITS_OK)
+			return status;
+	}
+	return ITS_OK;
+}
+
+/* Solves a loaded instance with pp->workers runs working in threads of
+ their own and sharing an elite pool (see 'elite.h'). Run 0 takes
+ streams 3w..3w+2 of the generator pp->rng_kind seeded with pp->seed (see
+ 'rng.h'); with RNG_LEGACY run w is seeded with seed+w*COOP_SEED_STEP
+ instead. Each run splits the scans of tabu_search across
+ pp->scan_threads threads if the graph is large enough; this does not
+ change its result. With swap_cand>0 the swap moves are first looked for
+ among the swap_cand members and non-members with the best gains (see
+ swap_restricted); 0 scans all pairs. With trace_size>0 each run records
+ its improvements in a ring of that many points, and the merged curve is
+ returned in *pres ('trace.h'). Sparse storage scans its swaps on its
+ own (see sparse_top), without threads or candidate lists.
+ Nothing is written and nothing exits: the best solution of all runs
+ goes to *pres, reallocating its sol and trace, and an error is
+ returned instead. The buffers of the runs are kept in *ps and reused
+ by the next call if the instance has the same order and storage and
+ the parameters match. The instance is only read, and there is no other
+ state, so calls with distinct solvers may run at the same time, over
+ the same instance or not. Bounds outside 1..size give ITS_ERR_PARAMS;
+ b1=b2=size gives the whole vertex set. A solution found outside the
+ bounds is never returned: the call fails with ITS_ERR_INTERNAL. */
+int ITS_solve(Weights *pweight, const Params *pp, Solver *ps,
+		Results *pres) {
+	SearchState *pst;
+	Rng master;
+	Trace *traces;
+	TracePoint *merged;
+	Worker *pw;
+	int *psol;
+
+	int i, j, w, win, status;
+	int size = pweight->size, cl_size = 0;
+	int workers = pp->workers < 1 ? 1 : pp->workers;
+	int scan_threads = pp->scan_threads < 1 ? 1 : pp->scan_threads;
 	int keep_tabu_time1;
 	int perturb_count;
-	int time_values[5], time_values_opt[5];
-	long lo, e_count;
+	int starts = 0;
+	long lo;
 	long it_bound;
-	long time_in_seconds;
-	double w;
-	double value, value_from_sol = 0;
-	clock_t start;
-
-	if ((in = fopen(in_file_name, "r")) == NULL) {
-		printf("  fopen failed for input");
-		exit(1);
-	}
-	fscanf(in, "%d", &size);
-	if ((out = fopen(out_file_name, "w")) == NULL) {
-		printf("  fopen failed for output  %s", out_file_name);
-		exit(1);
-	}
-	ALMF(pweight, size+1)
-	for (i = 0; i <= size; i++)
-		ALF(*(pweight+i), size+1)
-	ALM(ptabu, size+1)
-	for (i = 0; i <= size; i++)
-		ALI(*(ptabu+i), size+1)
-	ALI(vert1, TABU_TIME2+1)
-	ALI(vert2, TABU_TIME2+1)
-	ALS(psol, Solution, size+1)
+	long iterations = 0;
+	Budget budget;
+
+	if (size < 2 || pp->b1 < 1 || pp->b1 > pp->b2 || pp->b2 > size)
+		return ITS_ERR_PARAMS;
+	if ((status = solver_setup(ps, pweight, pp, workers, scan_threads))
+			!= ITS_OK) {
+		ITS_solver_free(ps);
+		return status;
+	}
 	keep_tabu_time1 = TABU_TIME1;
 	i = size / TABU_COEF;
 	if (i < keep_tabu_time1)
 		keep_tabu_time1 = i;
 	it_bound = ITERATIONS_FIXED_BOUND;
-	lo = ((long) size) * iterations_coef;
+	lo = ((long) size) * pp->iterations_coef;
 	if (it_bound < lo)
 		it_bound = lo;
 	perturb_count = size * PER_COEF;
-	e_count = ((long) size) * (size - 1) / 2;
-	for (lo = 1; lo <= e_count; lo++) {
-		fscanf(in, "%d %d %lf", &i, &j, &w);
-		i++;
-		j++;
-		weight(i,j) = w;
-		weight(j,i) = w;
-	}
-	start = clock();
-	value = ITS_internal(out, size, b1, b2, time_limit, keep_tabu_time1,
-			TABU_TIME2, perturb_count, MIN_PER_COUNT, LIST_SIZE, it_bound,
-			vert1, vert2, time_values_opt, &seed, start, pweight, ptabu, psol);
-	time_in_seconds = take_time(time_values, start);
+	budget_start(&budget, &pp->limits);
+	rng_seed(&master, pp->rng_kind, pp->seed);
+	for (w = 0; w < workers; w++) {
+		pw = ps->pworker + w;
+		pw->pweight = pweight;
+		pw->pe = ps->pool;
+		pw->state.wmin = pweight->wmin;
+		pw->budget = budget;
+		if (workers > 1)
+			pw->budget.stop = &ps->pool->stop;
+		if (pp->rng_kind == RNG_LEGACY)
+			rng_seed(&master, pp->rng_kind, pp->seed + w * COOP_SEED_STEP);
+		for (i = 0; i < 3; i++)
+			if (pp->rng_kind == RNG_LEGACY)
+				rng_stream(&master, i, pw->rng + i);
+			else
+				rng_stream(&master, 3 * w + i, pw->rng + i);
+		pw->b1 = pp->b1;
+		pw->b2 = pp->b2;
+		pw->keep_tabu_time1 = keep_tabu_time1;
+		pw->perturb_count = perturb_count;
+		pw->it_bound = it_bound;
+	}
+	for (w = 1; w < workers; w++)
+		if (pthread_create(ps->threads + w, NULL, coop_worker, ps->pworker + w)
+				!= 0) {
+			status = ITS_ERR_THREAD;
+			__atomic_store_n(&ps->pool->stop, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	if (status == ITS_OK)
+		coop_worker(ps->pworker);
+	for (i = 1; i < w; i++)
+		pthread_join(*(ps->threads + i), NULL);
+	if (status != ITS_OK)
+		return status;
+	win = 0;
+	for (w = 0; w < workers; w++) {
+		pw = ps->pworker + w;
+		if (pw->state.status != ITS_OK)
+			return pw->state.status;
+		if (pw->value > (ps->pworker + win)->value)
+			win = w;
+		starts += pw->state.stats.starts;
+		iterations += pw->budget.iterations;
+	}
+	ps->win = win;
+	pst = &(ps->pworker + win)->state;
+	psol = (int *) realloc(pres->sol, (size + 1) * sizeof(int));
+	if (psol == NULL)
+		return ITS_ERR_MEMORY;
+	pres->sol = psol;
+	*psol = 0;
 	for (i = 1; i <= size; i++) {
-		if ((psol + i)->best_sol != 1)
+		sol(i) = *(pst->best_sol + i);
+		if (sol(i) == 1)
+			cl_size++;
+	}
+	if (cl_size < pp->b1 || cl_size > pp->b2)
+		return ITS_ERR_INTERNAL;
+	pres->value = (ps->pworker + win)->value;
+	pres->time_to_opt = pst->stats.time_to_opt / 1000.;
+	pres->total_time = budget_elapsed(&budget) / 1000.;
+	pres->characts[0] = size;
+	pres->characts[1] = (long) pp->limits.time_ms;
+	pres->characts[2] = starts;
+	pres->characts[3] = pst->stats.improvements;
+	pres->characts[4] = pst->stats.last_start;
+	pres->characts[5] = pp->b1;
+	pres->characts[6] = pp->b2;
+	pres->characts[7] = cl_size;
+	pres->characts[8] = iterations;
+	pres->characts[9] = it_bound;
+	pres->trace_count = 0;
+	pres->trace_dropped = 0;
+	if (pp->trace_size > 0) {
+		ALR(traces, Trace, workers)
+		j = 0;
+		for (w = 0; w < workers; w++) {
+			*(traces + w) = (ps->pworker + w)->state.trace;
+			j += (traces + w)->count;
+			pres->trace_dropped += (traces + w)->dropped;
+		}
+		merged = (TracePoint *) realloc(pres->trace,
+				(j + 1) * sizeof(TracePoint));
+		if (merged == NULL) {
+			free(traces);
+			return ITS_ERR_MEMORY;
+		}
+		pres->trace = merged;
+		pres->trace_count = trace_merge(traces, workers, merged);
+		free(traces);
+	}
+	return ITS_OK;
+}
+
+/* Writes the report of the ITS_solve() call that left *ps and *pres to
+ out_file_name, with the merged trace in <out_file_name>.trace.csv if
+ it was traced. Returns ITS_OK, or ITS_ERR_OPEN if the report cannot be
+ written. */
+int ITS_report(const char *out_file_name, Weights *pweight,
+		const Params *pp, const Solver *ps, const Results *pres) {
+	FILE *out;
+	const SearchState *pst = &(ps->pworker + ps->win)->state;
+	const Limits *plimits = &pp->limits;
+	char trace_file_name[1024];
+
+	int i, j;
+	int size = pweight->size;
+	int time_values[5], time_values_opt[5];
+	long lo;
+	long time_in_seconds;
+	double value = pres->value, value_from_sol = 0;
+	double total_ms = pres->total_time * 1000.;
+
+	if ((out = fopen(out_file_name, "w")) == NULL)
+		return ITS_ERR_OPEN;
+	time_in_seconds = take_time(time_values, total_ms);
+	for (i = 1; pweight->kind != WEIGHTS_SPARSE && i < size; i++) {
+		if (sol(i) != 1)
 			continue;
-		cl_size++;
 		for (j = i + 1; j <= size; j++)
-			if ((psol + j)->best_sol == 1)
+			if (sol(j) == 1)
 				value_from_sol += weight(i,j);
 	}
+	if (pweight->kind == WEIGHTS_SPARSE)
+		value_from_sol = sparse_value(pweight, pres->sol, size);
 	fprintf(out, "   graph order                    = %5d\n", size);
-	fprintf(out, "   lower bound                    = %5d\n", b1);
-	fprintf(out, "   upper bound                    = %5d\n", b2);
-	fprintf(out, "   time limit                     = %5ld\n", time_limit);
-	fprintf(out, "   number of iterations per start = %10ld\n", it_bound);
-	fprintf(out, "   number of starts executed      = %3d\n",
-			(psol + 5)->performance);
+	fprintf(out, "   lower bound                    = %5d\n", pp->b1);
+	fprintf(out, "   upper bound                    = %5d\n", pp->b2);
+	fprintf(out, "   time limit, ms                 = %10.3lf\n",
+			plimits->time_ms);
+	if (plimits->iterations > 0)
+		fprintf(out, "   iteration limit                = %10ld\n",
+				plimits->iterations);
+	if (plimits->has_target)
+		fprintf(out, "   target value                   = %11.3lf\n",
+				plimits->target);
+	fprintf(out, "   number of iterations per start = %10ld\n",
+			pres->characts[9]);
+	if (ps->workers > 1)
+		fprintf(out, "   cooperating runs               = %3d\n", ps->workers);
+	if (pp->swap_cand > 0 && pweight->kind != WEIGHTS_SPARSE)
+		fprintf(out, "   swap candidate lists           = %5d\n",
+				pp->swap_cand);
+	if (pp->rng_kind == RNG_XOSHIRO)
+		fprintf(out, "   random numbers                 = xoshiro256**\n");
+	fprintf(out, "   number of starts executed      = %3ld\n",
+			pres->characts[2]);
 	fprintf(out, "   number of improvements         = %3d\n",
-			(psol + 1)->performance);
+			pst->stats.improvements);
 	fprintf(out, "   last improvement at start no.  = %2d\n",
-			(psol + 3)->performance);
+			pst->stats.last_start);
 	if (value < value_from_sol - 0.00001 || value > value_from_sol + 0.00001)
 		fprintf(out,
 				"!!! some discrepancy in solution values: %11.3lf   %11.3lf\n",
@@ -784,32 +2423,69 @@ void ITS(char *in_file_name, char *out_file_name, int b1, int b2, double seed,
 	else
 		fprintf(out, "   solution value                 = %11.3lf  %11.3lf\n",
 				value_from_sol, value);
-	fprintf(out, "   subgraph size                  = %5d\n", cl_size);
-	lo = 3600 * (long) time_values_opt[1] + 60 * time_values_opt[2]
-			+ time_values_opt[3];
-	fprintf(out, "   time to solution: %d : %d : %d.%3d  (=%4ld seconds)\n",
+	fprintf(out, "   subgraph size                  = %5ld\n",
+			pres->characts[7]);
+#if GAIN_VERIFY
+	fprintf(out, "   largest drift of gains/value   = %11.3le  %11.3le\n",
+			pst->stats.gain_drift, pst->stats.value_drift);
+#endif
+	fprintf(out, "   number of iterations           = %10ld\n",
+			pres->characts[8]);
+	lo = take_time(time_values_opt, pst->stats.time_to_opt);
+	fprintf(out, "   time to solution: %d : %d : %d.%06d  (=%4ld seconds)\n",
 			time_values_opt[1], time_values_opt[2], time_values_opt[3],
 			time_values_opt[4], lo);
-	fprintf(out, "   total time: %d : %d : %d.%3d  (=%4ld seconds)\n",
+	fprintf(out, "   total time: %d : %d : %d.%06d  (=%4ld seconds)\n",
 			time_values[1], time_values[2], time_values[3], time_values[4],
 			time_in_seconds);
 	fprintf(out, "\n");
-	if (pres != NULL) {
-		ALI(pres->sol, size+1)
-		for (i = 1; i <= size; i++)
-			sol(i) = (psol + i)->best_sol;
-		pres->value = value;
-		pres->time_to_opt = lo;
-		pres->total_time = time_in_seconds;
-		pres->characts[0] = size;
-		pres->characts[1] = time_limit;
-		pres->characts[2] = (psol + 5)->performance;
-		pres->characts[3] = (psol + 1)->performance;
-		pres->characts[4] = (psol + 3)->performance;
-		pres->characts[5] = b1;
-		pres->characts[6] = b2;
-		pres->characts[7] = cl_size;
-	}
-	fclose(out);
-	fclose(in);
+#if ITS_STATS
+	write_stats(out_file_name, ps->pworker, ps->workers, size, total_ms);
+#endif
+	if (pp->trace_size > 0) {
+		snprintf(trace_file_name, sizeof(trace_file_name), "%s.trace.csv",
+				out_file_name);
+		if (trace_write(trace_file_name, pres->trace, pres->trace_count)
+				!= 0)
+			fprintf(out, "  failed to write %s\n", trace_file_name);
+	}
+	return fclose(out) == 0 ? ITS_OK : ITS_ERR_OPEN;
+}
+
+/* Solves a loaded instance by ITS_solve() with a solver of its own and
+ writes the report by ITS_report(); returns ITS_OK or the error of
+ either. On success the solution and the trace go to *pres, if not NULL,
+ to be freed by the caller. With one run this is ITS_run(). */
+int ITS_coop(Weights *pweight, char *out_file_name, int b1, int b2,
+		double seed, long iterations_coef, const Limits *plimits, int workers,
+		int scan_threads, int swap_cand, int rng_kind, int trace_size,
+		Results *pres) {
+	Solver solver;
+	Params params;
+	Results res;
+	int status;
+
+	params.b1 = b1;
+	params.b2 = b2;
+	params.seed = seed;
+	params.iterations_coef = iterations_coef;
+	params.limits = *plimits;
+	params.workers = workers;
+	params.scan_threads = scan_threads;
+	params.swap_cand = swap_cand;
+	params.rng_kind = rng_kind;
+	params.trace_size = trace_size;
+	memset(&res, 0, sizeof(Results));
+	ITS_solver_init(&solver);
+	status = ITS_solve(pweight, &params, &solver, &res);
+	if (status == ITS_OK)
+		status = ITS_report(out_file_name, pweight, &params, &solver, &res);
+	ITS_solver_free(&solver);
+	if (status == ITS_OK && pres != NULL)
+		*pres = res;
+	else {
+		free(res.sol);
+		free(res.trace);
+	}
+	return status;
 }
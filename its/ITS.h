@@ -1,4 +1,10 @@
+#include <math.h>
 #include <stdio.h>
+#include "budget.h"
+#include "parallel.h"
+#include "loader.h"
+#include "rng.h"
+#include "trace.h"
 
 #define TABU_COEF                    4
 #define TABU_TIME1                  20
@@ -7,47 +13,238 @@
 #define PER_COEF                   0.1
 #define MIN_PER_COUNT               10
 #define LIST_SIZE                    5 
+#define FUSED_GAIN_UPDATE            0  /* 1: a swap adds w2-w1 to the gains  */
+                                        /* in one pass; not bit-identical     */
+#define GAIN_RESYNC_PERIOD        1000  /* moves between exact recomputations */
+                                        /* of the gains in packed storage     */
+#define COOP_SEED_STEP            7919  /* seed offset between cooperating    */
+                                        /* runs of ITS_coop()                 */
+#define PAR_MIN_SIZE              2000  /* smallest graph order for which the */
+                                        /* scans of tabu_search are split     */
+                                        /* across threads                     */
+#define PAR_PARTS_PER_THREAD         2  /* parts a scan is split into, per    */
+                                        /* thread                             */
+#define GAIN_VERIFY                  0  /* 1: recompute the gains at each     */
+                                        /* tabu search start and record the   */
+                                        /* drift                              */
+#define ITS_STATS                    0  /* 1: count moves, time the phases of */
+                                        /* the search and write them to       */
+                                        /* <output file>.json                 */
+
+#if ITS_STATS
+#define STAT_ADD(PST,F,X)   ((PST)->stats.F += (X))
+#define STAT_TIMER(T)       double T = clock_ms()
+#define STAT_RESET(T)       ((T) = clock_ms())
+#define STAT_TIME(PST,F,T)  ((PST)->stats.F += clock_ms() - (T))
+#else
+#define STAT_ADD(PST,F,X)
+#define STAT_TIMER(T)
+#define STAT_RESET(T)
+#define STAT_TIME(PST,F,T)
+#endif
 
 #define NEG_LARGE_LONG        -1000000
 #define POS_LARGE_INT         30000
 #define	CLK_TCK		CLOCKS_PER_SEC
-#define ALS(X,Y,Z) if ((X=(Y *)calloc(Z,sizeof(Y)))==NULL) \
-       {fprintf(out,"  failure in memory allocation\n");exit(0);}
-#define ALI(X,Z) if ((X=(int *)calloc(Z,sizeof(int)))==NULL) \
-       {fprintf(out,"  failure in memory allocation\n");exit(0);}
-#define ALF(X,Z) if ((X=(double *)calloc(Z,sizeof(double)))==NULL) \
-       {fprintf(out,"  failure in memory allocation\n");exit(0);}
-#define ALM(X,Z) if ((X=(int **)calloc(Z,sizeof(int *)))==NULL) \
-       {fprintf(out,"  failure in memory allocation\n");exit(0);}
-#define ALMF(X,Z) if ((X=(double **)calloc(Z,sizeof(double *)))==NULL) \
-       {fprintf(out,"  failure in memory allocation\n");exit(0);}
-
-#define weight(X,Y) *(*(pweight+X)+Y)
-#define tabu(X,Y) *(*(ptabu+X)+Y)
+
+#define ITS_OK                       0
+#define ITS_ERR_MEMORY              -1  /* allocation failed                  */
+#define ITS_ERR_OPEN                -2  /* file cannot be opened              */
+#define ITS_ERR_FORMAT              -3  /* malformed input file               */
+#define ITS_ERR_PARAMS              -4  /* parameters unfit for the instance  */
+#define ITS_ERR_THREAD              -5  /* a thread could not be started      */
+#define ITS_ERR_INTERNAL            -6  /* solution values disagree, or the   */
+                                        /* solution breaks the bounds         */
+
+/* allocations in functions returning ITS_ERR_MEMORY on failure */
+#define ALR(X,Y,Z) if ((X=(Y *)calloc(Z,sizeof(Y)))==NULL) \
+       return ITS_ERR_MEMORY;
+#define ALRA(X,Y,Z) if (posix_memalign((void **)&(X),WEIGHT_ALIGN, \
+       (Z)*sizeof(Y))!=0) \
+       {X=NULL;return ITS_ERR_MEMORY;} \
+       else memset(X,0,(Z)*sizeof(Y));
+
+#define wrow(X) (pweight->w+(long)(X)*pweight->stride)
+#define weight(X,Y) get_weight(pweight,X,Y)
 #define sol(Y) *(pres->sol+Y)
 
 typedef struct
-     {int sol;            /*  */
-      int best_sol;       /*  */
-      int val;            /*  */
-      int t;              /*  */
-      int cand1;          /*  */
-      int cand2;          /*  */
-      int performance;    /*  */
-      double cl;           /*  */
-      double d;            /*  */
-      double s1;           /*  */
-      double sf;           /*  */
-     }Solution;
+     {int kind;           /* storage kind, one of WEIGHTS_*                   */
+      double *w;          /* WEIGHTS_DENSE: coefficients c_ij, row-major, one */
+                          /* contiguous block aligned to WEIGHT_ALIGN bytes;  */
+                          /* rows and columns are indexed 1..size, entry 0    */
+                          /* unused.  WEIGHTS_PACKED_DOUBLE: c_ij for i<j,    */
+                          /* row by row (c_12..c_1n, c_23..c_2n, ...)         */
+                          /* WEIGHTS_POINTS: coordinate t of point i at       */
+                          /* w[t*stride+i], t=0..dim-1; c_ij is the Euclidean */
+                          /* distance of points i and j                       */
+      float *wf;          /* WEIGHTS_PACKED_FLOAT: as w for packed doubles    */
+      long stride;        /* WEIGHTS_DENSE: distance between rows, in         */
+                          /* entries; a multiple of WEIGHT_ALIGN/sizeof       */
+                          /* (double) so every row starts on a cache line.    */
+                          /* WEIGHTS_POINTS: the same for the coordinates     */
+      int dim;            /* WEIGHTS_POINTS: dimension of the points          */
+      long *xadj;         /* WEIGHTS_SPARSE: the neighbors of vertex i are    */
+                          /* adj[xadj[i]..xadj[i+1]-1], in increasing order,  */
+                          /* i=1..size, and adjw holds the weights of these   */
+                          /* edges; pairs missing from the lists weigh 0      */
+      int *adj;
+      double *adjw;
+      int size;           /* graph order                                      */
+      double wmin;        /* smallest weight, set by ITS_load()               */
+      BinaryFile file;    /* binary instance w or wf points into, if          */
+                          /* file.map is not NULL                             */
+     }Weights;
+
+/* position of c_ij, i<j, in packed upper-triangular storage */
+inline long packed_index(int size, int i, int j) {
+	return (long) (i - 1) * (2 * size - i) / 2 + (j - i - 1);
+}
+
+/* c_ij in sparse storage: binary search of j among the neighbors of i */
+inline double sparse_weight(const Weights *pweight, int i, int j) {
+	long lo = *(pweight->xadj + i), hi = *(pweight->xadj + i + 1) - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (*(pweight->adj + mid) < j)
+			lo = mid + 1;
+		else if (*(pweight->adj + mid) > j)
+			hi = mid - 1;
+		else
+			return *(pweight->adjw + mid);
+	}
+	return 0.;
+}
+
+/* c_ij for points: summed and rounded as by distance_row() ('kernels.h') */
+inline double point_distance(const Weights *pweight, int i, int j) {
+	int t;
+	const double *xt = pweight->w;
+	double d, s = 0.;
+
+	for (t = 0; t < pweight->dim; t++) {
+		d = *(xt + j) - *(xt + i);
+		s += d * d;
+		xt += pweight->stride;
+	}
+	return sqrt(s);
+}
+
+inline double get_weight(const Weights *pweight, int i, int j) {
+	int k;
+	if (pweight->kind == WEIGHTS_DENSE)
+		return *(wrow(i) + j);
+	if (pweight->kind == WEIGHTS_SPARSE)
+		return sparse_weight(pweight, i, j);
+	if (pweight->kind == WEIGHTS_POINTS)
+		return point_distance(pweight, i, j);
+	if (i == j)
+		return 0.;
+	if (i > j) {
+		k = i;
+		i = j;
+		j = k;
+	}
+	if (pweight->kind == WEIGHTS_PACKED_FLOAT)
+		return *(pweight->wf + packed_index(pweight->size, i, j));
+	return *(pweight->w + packed_index(pweight->size, i, j));
+}
+
+typedef struct
+     {int *cand1;         /* vertex to be moved, entries 1..LIST_SIZE         */
+      int *cand2;         /* vertex to be swapped in, or -1 for add/drop      */
+      double *d;          /* change of the objective made by the move         */
+     }Candidates;
+
+typedef struct
+     {int starts;         /* number of starts executed                        */
+      int improvements;   /* number of improvements of the best solution      */
+      int last_start;     /* start no. for the last improvement               */
+      long ls_moves;      /* number of moves made by local_search             */
+      double gain_drift;  /* largest drift of a gain seen (GAIN_VERIFY)      */
+      double value_drift; /* largest drift of the solution value (GAIN_VERIFY)*/
+      double time_to_opt; /* ms from the start to the best solution found     */
+      /* the rest is only counted with ITS_STATS */
+      long evaluated;     /* moves evaluated by tabu_search and local_search  */
+      long adds;          /* vertices added by tabu_search                    */
+      long drops;         /* vertices dropped by tabu_search                  */
+      long swaps;         /* swaps made by tabu_search                        */
+      long blocked;       /* moves passed over by tabu_search as tabu         */
+      long aspirations;   /* moves taken at once as improving the best value  */
+      double ms_start;    /* ms spent building the initial solution           */
+      double ms_tabu;     /* ms in tabu_search, local_search included         */
+      double ms_local;    /* ms in local_search                               */
+      double ms_perturb;  /* ms in get_solution                               */
+     }Stats;
+
+typedef struct
+     {int k, m;           /* swapped vertices, k dropped and m added          */
+      long until;         /* last iteration at which the pair is tabu         */
+     }TabuPair;
+
+typedef struct
+     {int *mask;          /* pair_mask of the part                            */
+      double *wbuf;       /* room for one expanded weight row                 */
+      int asp;            /* 1 if the part found an aspirating move           */
+      int pos;            /* vertex of the best move of the part, or -1       */
+      int pos2;           /* second vertex of a swap                          */
+      double best;        /* change of the objective made by that move        */
+      long evaluated;     /* moves evaluated by the part                      */
+      long blocked;       /* moves passed over as tabu (ITS_STATS)            */
+     }ScanPart;
+
+typedef struct
+     {int *sol;           /* current solution: 1 - in S, 0 - out of S         */
+                          /* (-1 - not yet decided, in steepest_ascent)       */
+      int *best_sol;      /* best solution found                              */
+      long *t;            /* last iteration at which the vertex is tabu       */
+      long iter;          /* iteration counter of tabu_search, never reset    */
+      TabuPair *pairs;    /* ring of tabu swap pairs in order of expiry       */
+      int pair_first;     /* ring position of the oldest pair                 */
+      int pair_count;     /* number of pairs in the ring                      */
+      int *pair_mask;     /* 1 for vertices forming a tabu pair with the      */
+                          /* in-set vertex scanned, 0 otherwise               */
+      int *val;           /* 1 if moved by the current perturbation           */
+      int *perm;          /* vertex permutation used by random_start          */
+      int *in_list;       /* members of S, entries 0..in_count-1              */
+      int *out_list;      /* non-members of S, entries 0..out_count-1         */
+      int *pos;           /* position of a vertex in in_list or out_list      */
+      int in_count;       /* |S|                                              */
+      int out_count;      /* size-|S|                                         */
+      double *cl;         /* gains: change of the objective when the vertex   */
+                          /* is added to (removed from) S is cl (-cl)         */
+      double *clout;      /* cl of out-of-S vertices, -INFINITY for members   */
+      double *wbuf;       /* room for two expanded weight rows                */
+      double *sf;         /* steepest_ascent: weight to undecided vertices    */
+      double *s1;         /* steepest_ascent: weight to vertices in S         */
+      Candidates cand;    /* perturbation candidates of get_solution          */
+      int *order;         /* heaps of the members and the non-members         */
+                          /* scanned for swaps                                */
+      Stats stats;        /* run counters                                     */
+      ParPool *par;       /* threads splitting the scans, or NULL             */
+      ScanPart *parts;    /* scratch and results of the parts of a scan       */
+      int part_count;     /* number of parts a scan is split into             */
+      int rcl_size;       /* length of the swap candidate lists, 0 - off      */
+      int *rcl_in;        /* members of S with the smallest gains             */
+      int *rcl_out;       /* non-members with the largest gains               */
+      double wmin;        /* smallest weight, bounds the gains of swaps       */
+      int *mark;          /* sparse storage: 1 for the neighbors of the       */
+                          /* member scanned, 0 otherwise                      */
+      int *top;           /* sparse storage: non-members with the largest     */
+                          /* gains, in decreasing order of gain               */
+      Trace trace;        /* improvements of the best value                   */
+      int status;         /* ITS_OK, or the error that stopped the run        */
+     }SearchState;
 
 typedef struct
      {int *sol;           /* solution obtained                                */
       double value;       /* its value                                        */
-      long time_to_opt;   /* time to solution, secs                           */
-      long total_time;    /* total time, secs                                 */
+      double time_to_opt; /* time to solution, secs                           */
+      double total_time;  /* total time, secs                                 */
       long characts[10];  /* some characteristics:                            */
                           /*    characts[0] - graph order                     */
-                          /*    characts[1] - time limit                      */
+                          /*    characts[1] - time limit, ms                  */
                           /*    characts[2] - number of starts executed       */
                           /*    characts[3] - number of solution improvements */
                           /*    characts[4] - start no. for the last          */
@@ -55,4 +252,60 @@ typedef struct
                           /*    characts[5] - lower bound on subgraph's size  */
                           /*    characts[6] - upper bound on subgraph's size  */
                           /*    characts[7] - subgraph's size                 */
+                          /*    characts[8] - number of iterations            */
+                          /*    characts[9] - number of iterations per start  */
+      TracePoint *trace;  /* improvements of the best value of the run, in    */
+                          /* time order, if traced; to be freed by the caller */
+                          /* (ITS_solve() reuses sol and trace, which must   */
+                          /* then be NULL or left from an earlier call)       */
+      int trace_count;    /* number of points in trace                        */
+      long trace_dropped; /* points lost because a ring was full              */
      }Results;
+
+/* Parameters of ITS_solve(), as those of ITS_coop(). */
+typedef struct
+     {int b1, b2;         /* bounds on the subgraph's size                    */
+      double seed;        /* seed of the random numbers                       */
+      long iterations_coef; /* iterations of a tabu search run per vertex     */
+      Limits limits;      /* when to stop, see 'budget.h'                     */
+      int workers;        /* cooperating runs                                 */
+      int scan_threads;   /* threads splitting the scans of each run          */
+      int swap_cand;      /* length of the swap candidate lists, 0 - off      */
+      int rng_kind;       /* random number generator, one of RNG_*            */
+      int trace_size;     /* points of the convergence trace, 0 - off         */
+     }Params;
+
+struct Worker;
+struct ElitePool;
+
+/* Search state of ITS_solve(), kept between calls so that solving
+ instances of one order again allocates nothing. Set up by
+ ITS_solver_init(), used by one ITS_solve() call at a time. */
+typedef struct
+     {int size;           /* graph order the buffers are sized for, 0 - none  */
+      int kind;           /* storage kind they are set up for                 */
+      int workers;        /* runs set up                                      */
+      int scan_threads;   /* as in the Params of the buffers                  */
+      int swap_cand;
+      int trace_size;
+      int win;            /* run that found the best solution last time       */
+      struct Worker *pworker; /* the runs, workers entries                    */
+      pthread_t *threads; /* their threads, entry 0 unused                    */
+      struct ElitePool *pool; /* shared by the runs if workers>1, else NULL   */
+     }Solver;
+
+int ITS(char *, char *, int, int, double, long, long, Results *);
+int ITS_storage(char *, char *, int, int, double, long, const Limits *, int,
+		Results *);
+int ITS_load(const char *, int, int, Weights *);
+int ITS_run(Weights *, char *, int, int, double, long, const Limits *,
+		Results *);
+int ITS_coop(Weights *, char *, int, int, double, long, const Limits *, int,
+		int, int, int, int, Results *);
+void ITS_solver_init(Solver *);
+int ITS_solve(Weights *, const Params *, Solver *, Results *);
+int ITS_report(const char *, Weights *, const Params *, const Solver *,
+		const Results *);
+void ITS_solver_free(Solver *);
+const char *ITS_error(int);
+void free_weights(Weights *);
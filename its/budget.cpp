@@ -0,0 +1,86 @@
+/* Run budget of ITS, see 'budget.h'. */
+
+#include <time.h>
+#include "budget.h"
+
+double clock_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000. + ts.tv_nsec / 1000000.;
+}
+
+static void budget_schedule(Budget *pb) {
+	pb->next_check = pb->iterations + pb->stride;
+	if (pb->limits.iterations > 0 && pb->next_check > pb->limits.iterations)
+		pb->next_check = pb->limits.iterations;
+}
+
+void budget_start(Budget *pb, const Limits *plimits) {
+	pb->limits = *plimits;
+	pb->start_ms = clock_ms();
+	pb->last_ms = 0.;
+	pb->iterations = 0;
+	pb->last_count = 0;
+	pb->stride = 1;
+	pb->exhausted = 0;
+	pb->stop = NULL;
+	budget_schedule(pb);
+}
+
+/* Milliseconds since budget_start(). */
+double budget_elapsed(const Budget *pb) {
+	return clock_ms() - pb->start_ms;
+}
+
+/* Slow path of budget_tick(): checks the limits and sets the number of
+ iterations until the next check from the rate since the previous one.
+ The stride at most doubles between checks so that a slow phase after a
+ fast one is noticed in time. */
+int budget_check(Budget *pb) {
+	long stride;
+	double now;
+
+	if (pb->exhausted)
+		return 1;
+	if (pb->stop != NULL && __atomic_load_n(pb->stop, __ATOMIC_RELAXED)) {
+		pb->exhausted = 1;
+		return 1;
+	}
+	if (pb->limits.iterations > 0 && pb->iterations >= pb->limits.iterations) {
+		pb->exhausted = 1;
+		return 1;
+	}
+	now = budget_elapsed(pb);
+	if (pb->limits.time_ms > 0 && now >= pb->limits.time_ms) {
+		pb->exhausted = 1;
+		return 1;
+	}
+	if (now > pb->last_ms)
+		stride = (long) ((pb->iterations - pb->last_count) * BUDGET_CHECK_MS
+				/ (now - pb->last_ms));
+	else
+		stride = 2 * pb->stride;
+	if (stride > 2 * pb->stride)
+		stride = 2 * pb->stride;
+	if (stride > BUDGET_MAX_STRIDE)
+		stride = BUDGET_MAX_STRIDE;
+	if (stride < 1)
+		stride = 1;
+	pb->stride = stride;
+	pb->last_ms = now;
+	pb->last_count = pb->iterations;
+	budget_schedule(pb);
+	return 0;
+}
+
+/* Reports the value of a new best solution; returns 1 if it reaches the
+ target. */
+int budget_value(Budget *pb, double value) {
+	if (pb->limits.has_target && value >= pb->limits.target - 0.00001) {
+		pb->exhausted = 1;
+		pb->next_check = pb->iterations;
+		if (pb->stop != NULL)
+			__atomic_store_n(pb->stop, 1, __ATOMIC_RELAXED);
+	}
+	return pb->exhausted;
+}
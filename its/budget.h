@@ -0,0 +1,47 @@
+/* Run budget of ITS.
+ A run stops when any of the limits set in Limits is reached: the wall
+ clock time in milliseconds, the total number of tabu search iterations
+ or a target value of the objective.  The time is read from the
+ monotonic clock, but not at every iteration: budget_tick() only counts
+ iterations and reads the clock once every 'stride' of them, where
+ stride is adapted to the observed iteration rate so that the clock is
+ read about every BUDGET_CHECK_MS milliseconds.  A time limit is
+ therefore overrun by at most about BUDGET_CHECK_MS plus the duration of
+ one iteration.  Budgets of cooperating runs may share a stop flag:
+ reaching the target in one of them then stops all of them at their
+ next clock reading. */
+
+#define BUDGET_CHECK_MS           0.25  /* aimed at interval between reads  */
+#define BUDGET_MAX_STRIDE        65536  /* iterations between clock reads   */
+
+typedef struct
+     {double time_ms;     /* wall clock limit, ms; <= 0 - none                */
+      long iterations;    /* limit on tabu search iterations; <= 0 - none     */
+      double target;      /* stop when a solution of this value is found      */
+      int has_target;     /* 1 if target is set                               */
+     }Limits;
+
+typedef struct
+     {Limits limits;      /* limits of the run                                */
+      double start_ms;    /* clock reading at the start of the run            */
+      double last_ms;     /* elapsed time at the last clock reading           */
+      long iterations;    /* iterations counted so far                        */
+      long last_count;    /* iterations at the last clock reading             */
+      long next_check;    /* iteration count of the next clock reading        */
+      long stride;        /* iterations between clock readings                */
+      int exhausted;      /* 1 once a limit has been reached                  */
+      int *stop;          /* flag shared by cooperating runs, or NULL         */
+     }Budget;
+
+double clock_ms(void);
+void budget_start(Budget *pb, const Limits *plimits);
+double budget_elapsed(const Budget *pb);
+int budget_check(Budget *pb);
+int budget_value(Budget *pb, double value);
+
+/* Counts one iteration; returns 1 if the run has to stop. */
+static inline int budget_tick(Budget *pb) {
+	if (++(pb->iterations) < pb->next_check)
+		return 0;
+	return budget_check(pb);
+}
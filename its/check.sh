@@ -0,0 +1,61 @@
+#!/bin/sh
+# Regression runs of its over the instances of a directory: each listed
+# instance is solved with the listed bounds (-b) and an iteration limit,
+# and must end with status 0 and a subgraph of the expected size in the
+# output of every run.  Then
+# itsd is sent requests on one of them, b1=b2=n first, and must answer
+# every request with a subgraph of the requested size.
+# Usage: check.sh [data_dir]
+
+DATA=$(cd "${1:-./data}" && pwd) || exit 1
+BIN=$(cd "$(dirname "$0")" && pwd)/its
+ITSD=$(cd "$(dirname "$0")/.." && pwd)/itsd/itsd
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/its_check.XXXXXX") || exit 1
+trap 'rm -rf "$WORK"' EXIT
+fail=0
+
+# instance, bounds, subgraph size; b1=b2=n leaves no move to the search
+while read name bounds size; do
+	rm -f "$WORK"/*
+	(cd "$WORK" && "$BIN" -t 0 -i 2000 -j 1 -b "$bounds" "$DATA/$name" \
+			out.txt sum.txt >/dev/null 2>&1)
+	status=$?
+	if [ $status -ne 0 ]; then
+		echo "FAIL $name: exit status $status"
+		fail=1
+		continue
+	fi
+	bad=0
+	for f in "$WORK"/out*.txt; do
+		if ! grep -q "subgraph size *= *$size\$" "$f"; then
+			echo "FAIL $name: $(basename "$f") has no subgraph of size $size"
+			bad=1
+		fi
+	done
+	[ $bad -eq 0 ] && echo "ok   $name -b $bounds" || fail=1
+done <<LIST
+GKD-a_1_n10_m2.txt 2 2
+GKD-a_75_n30_m24.txt 24 24
+GKD-a_75_n30_m24.txt 30 30
+MDG-b_1_n500_m50.txt 50 50
+m3.txt 3 3
+m4.txt 4 4
+m50.txt 50 50
+LIST
+
+f="$DATA/GKD-a_75_n30_m24.txt"
+printf '{"instance": "%s", "b1": %d, "b2": %d, "iterations": 2000, "id": %d}\n' \
+		"$f" 30 30 1 "$f" 24 24 2 | "$ITSD" -j 1 >"$WORK/answers" 2>&1
+status=$?
+if [ $status -ne 0 ]; then
+	echo "FAIL itsd: exit status $status"
+	fail=1
+elif ! grep -q '"id": 1, "status": "ok", .*"size": 30,' "$WORK/answers" \
+		|| ! grep -q '"id": 2, "status": "ok", .*"size": 24,' "$WORK/answers"
+then
+	echo "FAIL itsd: $(cat "$WORK/answers")"
+	fail=1
+else
+	echo "ok   itsd"
+fi
+exit $fail
@@ -0,0 +1,102 @@
+/* Elite pool shared by cooperating ITS runs, see 'elite.h'. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ITS.h"
+#include "elite.h"
+
+/* Returns ITS_OK or ITS_ERR_MEMORY; the pool is to be freed either way. */
+int elite_alloc(int size, ElitePool *pe) {
+	pe->size = size;
+	pe->sols = NULL;
+	pe->values = NULL;
+	pthread_mutex_init(&pe->lock, NULL);
+	elite_clear(pe);
+	ALR(pe->sols, int, ELITE_SIZE*(size+1))
+	ALR(pe->values, double, ELITE_SIZE)
+	return ITS_OK;
+}
+
+/* Empties the pool for another set of runs. */
+void elite_clear(ElitePool *pe) {
+	pe->count = 0;
+	pe->best = -INFINITY;
+	pe->worst = -INFINITY;
+	pe->stop = 0;
+}
+
+void elite_free(ElitePool *pe) {
+	pthread_mutex_destroy(&pe->lock);
+	free(pe->sols);
+	free(pe->values);
+}
+
+double elite_best(ElitePool *pe) {
+	double best;
+	__atomic_load(&pe->best, &best, __ATOMIC_ACQUIRE);
+	return best;
+}
+
+/* Offers a solution to the pool; returns 1 if it was taken. */
+int elite_offer(ElitePool *pe, const int *sol, double value) {
+	int k, minind;
+	int size = pe->size;
+	double best, worst;
+
+	__atomic_load(&pe->best, &best, __ATOMIC_RELAXED);
+	while (value > best
+			&& !__atomic_compare_exchange(&pe->best, &best, &value, 1,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+	__atomic_load(&pe->worst, &worst, __ATOMIC_RELAXED);
+	if (value <= worst)
+		return 0;
+	pthread_mutex_lock(&pe->lock);
+	for (k = 0; k < pe->count; k++)
+		if (memcmp(pe->sols + k * (size + 1) + 1, sol + 1,
+				size * sizeof(int)) == 0) {
+			pthread_mutex_unlock(&pe->lock);
+			return 0;
+		}
+	if (pe->count < ELITE_SIZE)
+		minind = (pe->count)++;
+	else {
+		minind = 0;
+		for (k = 1; k < pe->count; k++)
+			if (*(pe->values + k) < *(pe->values + minind))
+				minind = k;
+		if (value <= *(pe->values + minind)) {
+			pthread_mutex_unlock(&pe->lock);
+			return 0;
+		}
+	}
+	memcpy(pe->sols + minind * (size + 1), sol, (size + 1) * sizeof(int));
+	*(pe->values + minind) = value;
+	if (pe->count == ELITE_SIZE) {
+		minind = 0;
+		for (k = 1; k < pe->count; k++)
+			if (*(pe->values + k) < *(pe->values + minind))
+				minind = k;
+		__atomic_store(&pe->worst, pe->values + minind, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&pe->lock);
+	return 1;
+}
+
+/* Copies a solution picked at random from the pool into sol and returns
+ its value, or -INFINITY if the pool is empty. */
+double elite_pick(ElitePool *pe, int *sol, Rng *prng) {
+	int k;
+	double value = -INFINITY;
+
+	pthread_mutex_lock(&pe->lock);
+	if (pe->count > 0) {
+		k = rng_next(prng) * pe->count;
+		memcpy(sol, pe->sols + k * (pe->size + 1),
+				(pe->size + 1) * sizeof(int));
+		value = *(pe->values + k);
+	}
+	pthread_mutex_unlock(&pe->lock);
+	return value;
+}
@@ -0,0 +1,33 @@
+/* Elite pool shared by cooperating ITS runs.
+ The pool keeps up to ELITE_SIZE best distinct solutions found by all
+ runs.  A run publishes its best solution when it improves and, every
+ ELITE_PERIOD-th restart, perturbs a solution taken from the pool
+ instead of its own current one, provided the pool holds something better
+ than the run's own best.  The best value is also kept in a separate slot
+ that is updated by compare-and-swap and read without locking; the
+ solutions themselves are guarded by a mutex, which is taken only when an
+ offered solution could enter the pool. */
+
+#include <pthread.h>
+
+#define ELITE_SIZE                   8
+#define ELITE_PERIOD                 4
+
+typedef struct ElitePool
+     {int size;           /* graph order                                      */
+      int count;          /* number of solutions in the pool                  */
+      int *sols;          /* solution k at sols+k*(size+1), entries 1..size   */
+      double *values;     /* values of the solutions                          */
+      double best;        /* best value in the pool, accessed atomically      */
+      double worst;       /* value to be beaten to enter a full pool,         */
+                          /* accessed atomically                              */
+      int stop;           /* shared stop flag of the budgets                  */
+      pthread_mutex_t lock;
+     }ElitePool;
+
+int elite_alloc(int size, ElitePool *pe);
+void elite_clear(ElitePool *pe);
+void elite_free(ElitePool *pe);
+double elite_best(ElitePool *pe);
+int elite_offer(ElitePool *pe, const int *sol, double value);
+double elite_pick(ElitePool *pe, int *sol, Rng *prng);
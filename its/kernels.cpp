@@ -0,0 +1,436 @@
+/* Gain update kernels for ITS, see 'kernels.h'. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <immintrin.h>
+#include "kernels.h"
+
+typedef void (*row_kernel)(double *, const double *, int);
+typedef void (*swap_kernel)(double *, const double *, const double *, int,
+		int);
+typedef int (*scan_kernel)(const double *, const double *, const int *, int,
+		double, double *, long *);
+typedef void (*dist_kernel)(double *, const double *, long, int, int, int);
+
+typedef struct
+     {int kind;           /* GAIN_KERNEL_*                                    */
+      const char *name;   /* for reports                                      */
+      row_kernel add;     /* cl[j] += row[j], j=1..size                       */
+      row_kernel sub;     /* cl[j] -= row[j], j=1..size                       */
+      swap_kernel swap;   /* cl[j] += row2[j]-row1[j], j=1..size              */
+      scan_kernel scan;   /* swap neighborhood of one in-set vertex           */
+      dist_kernel dist;   /* distances from one point to all points           */
+     }GainKernels;
+
+static void add_scalar(double *cl, const double *row, int size) {
+	int j;
+	for (j = 1; j <= size; j++)
+		*(cl + j) += *(row + j);
+}
+
+static void sub_scalar(double *cl, const double *row, int size) {
+	int j;
+	for (j = 1; j <= size; j++)
+		*(cl + j) -= *(row + j);
+}
+
+static void swap_scalar(double *cl, const double *row1, const double *row2,
+		int size, int fused) {
+	int j;
+	if (fused)
+		for (j = 1; j <= size; j++)
+			*(cl + j) += *(row2 + j) - *(row1 + j);
+	else
+		for (j = 1; j <= size; j++) {
+			*(cl + j) -= *(row1 + j);
+			*(cl + j) += *(row2 + j);
+		}
+}
+
+__attribute__((target("avx2")))
+static void add_avx2(double *cl, const double *row, int size) {
+	int j;
+	for (j = 1; j + 3 <= size; j += 4)
+		_mm256_storeu_pd(cl + j,
+				_mm256_add_pd(_mm256_loadu_pd(cl + j),
+						_mm256_loadu_pd(row + j)));
+	for (; j <= size; j++)
+		*(cl + j) += *(row + j);
+}
+
+__attribute__((target("avx2")))
+static void sub_avx2(double *cl, const double *row, int size) {
+	int j;
+	for (j = 1; j + 3 <= size; j += 4)
+		_mm256_storeu_pd(cl + j,
+				_mm256_sub_pd(_mm256_loadu_pd(cl + j),
+						_mm256_loadu_pd(row + j)));
+	for (; j <= size; j++)
+		*(cl + j) -= *(row + j);
+}
+
+__attribute__((target("avx2")))
+static void swap_avx2(double *cl, const double *row1, const double *row2,
+		int size, int fused) {
+	int j;
+	__m256d c, w1, w2;
+	for (j = 1; j + 3 <= size; j += 4) {
+		c = _mm256_loadu_pd(cl + j);
+		w1 = _mm256_loadu_pd(row1 + j);
+		w2 = _mm256_loadu_pd(row2 + j);
+		if (fused)
+			c = _mm256_add_pd(c, _mm256_sub_pd(w2, w1));
+		else
+			c = _mm256_add_pd(_mm256_sub_pd(c, w1), w2);
+		_mm256_storeu_pd(cl + j, c);
+	}
+	for (; j <= size; j++)
+		if (fused)
+			*(cl + j) += *(row2 + j) - *(row1 + j);
+		else {
+			*(cl + j) -= *(row1 + j);
+			*(cl + j) += *(row2 + j);
+		}
+}
+
+__attribute__((target("avx512f")))
+static void add_avx512(double *cl, const double *row, int size) {
+	int j;
+	__mmask8 tail;
+	for (j = 1; j + 7 <= size; j += 8)
+		_mm512_storeu_pd(cl + j,
+				_mm512_add_pd(_mm512_loadu_pd(cl + j),
+						_mm512_loadu_pd(row + j)));
+	if (j <= size) {
+		tail = (__mmask8) ((1u << (size - j + 1)) - 1);
+		_mm512_mask_storeu_pd(cl + j, tail,
+				_mm512_add_pd(_mm512_maskz_loadu_pd(tail, cl + j),
+						_mm512_maskz_loadu_pd(tail, row + j)));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void sub_avx512(double *cl, const double *row, int size) {
+	int j;
+	__mmask8 tail;
+	for (j = 1; j + 7 <= size; j += 8)
+		_mm512_storeu_pd(cl + j,
+				_mm512_sub_pd(_mm512_loadu_pd(cl + j),
+						_mm512_loadu_pd(row + j)));
+	if (j <= size) {
+		tail = (__mmask8) ((1u << (size - j + 1)) - 1);
+		_mm512_mask_storeu_pd(cl + j, tail,
+				_mm512_sub_pd(_mm512_maskz_loadu_pd(tail, cl + j),
+						_mm512_maskz_loadu_pd(tail, row + j)));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void swap_avx512(double *cl, const double *row1, const double *row2,
+		int size, int fused) {
+	int j;
+	__mmask8 tail;
+	__m512d c, w1, w2;
+	for (j = 1; j <= size; j += 8) {
+		tail = (size - j >= 7) ? 0xff :
+				(__mmask8) ((1u << (size - j + 1)) - 1);
+		c = _mm512_maskz_loadu_pd(tail, cl + j);
+		w1 = _mm512_maskz_loadu_pd(tail, row1 + j);
+		w2 = _mm512_maskz_loadu_pd(tail, row2 + j);
+		if (fused)
+			c = _mm512_add_pd(c, _mm512_sub_pd(w2, w1));
+		else
+			c = _mm512_add_pd(_mm512_sub_pd(c, w1), w2);
+		_mm512_mask_storeu_pd(cl + j, tail, c);
+	}
+}
+
+/* Swap scans.  Candidate m, m=1..size, has gain clout[m], which is
+ -INFINITY for vertices in the solution; it is skipped when it is in the
+ solution or tabu[m] > 0.  All versions look for the first candidate
+ with the largest del: the lanes keep the first maximum they see and ties
+ between lanes go to the lower index. */
+
+static int scan_scalar_from(int m, const double *clout, const double *row,
+		const int *tabu, int size, double clk, double *del, int pos,
+		long *evaluated) {
+	double d;
+	for (; m <= size; m++) {
+		if (*(clout + m) == -INFINITY || *(tabu + m) > 0)
+			continue;
+		(*evaluated)++;
+		d = *(clout + m) - clk - *(row + m);
+		if (d > *del) {
+			*del = d;
+			pos = m;
+		}
+	}
+	return pos;
+}
+
+static int scan_scalar(const double *clout, const double *row,
+		const int *tabu, int size, double clk, double *del, long *evaluated) {
+	*del = -INFINITY;
+	return scan_scalar_from(1, clout, row, tabu, size, clk, del, -1,
+			evaluated);
+}
+
+__attribute__((target("avx2,popcnt")))
+static int scan_avx2(const double *clout, const double *row,
+		const int *tabu, int size, double clk, double *del, long *evaluated) {
+	int m, lane, ok, pos;
+	double vals[4];
+	long long idxs[4];
+	__m256d c, d, okd, gt, best = _mm256_set1_pd(-INFINITY);
+	__m256d vclk = _mm256_set1_pd(clk), ninf = _mm256_set1_pd(-INFINITY);
+	__m256i at = _mm256_set1_epi64x(-1), lanes = _mm256_set_epi64x(3, 2, 1, 0);
+
+	for (m = 1; m + 3 <= size; m += 4) {
+		c = _mm256_loadu_pd(clout + m);
+		okd = _mm256_and_pd(_mm256_cmp_pd(c, ninf, _CMP_NEQ_OQ),
+				_mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmpgt_epi32(
+						_mm_set1_epi32(1),
+						_mm_loadu_si128((const __m128i *) (tabu + m))))));
+		ok = _mm256_movemask_pd(okd);
+		if (ok == 0)
+			continue;
+		d = _mm256_sub_pd(_mm256_sub_pd(c, vclk), _mm256_loadu_pd(row + m));
+		*evaluated += __builtin_popcount(ok);
+		d = _mm256_blendv_pd(best, d, okd);
+		gt = _mm256_cmp_pd(d, best, _CMP_GT_OQ);
+		best = _mm256_blendv_pd(best, d, gt);
+		at = _mm256_castpd_si256(_mm256_blendv_pd(_mm256_castsi256_pd(at),
+				_mm256_castsi256_pd(
+						_mm256_add_epi64(lanes, _mm256_set1_epi64x(m))), gt));
+	}
+	_mm256_storeu_pd(vals, best);
+	_mm256_storeu_si256((__m256i *) idxs, at);
+	*del = -INFINITY;
+	pos = -1;
+	for (lane = 0; lane < 4; lane++)
+		if (idxs[lane] >= 0 && (vals[lane] > *del
+				|| (vals[lane] == *del && idxs[lane] < pos))) {
+			*del = vals[lane];
+			pos = (int) idxs[lane];
+		}
+	return scan_scalar_from(m, clout, row, tabu, size, clk, del, pos,
+			evaluated);
+}
+
+__attribute__((target("avx512f,avx2,popcnt")))
+static int scan_avx512(const double *clout, const double *row,
+		const int *tabu, int size, double clk, double *del, long *evaluated) {
+	int m, lane, pos;
+	unsigned ok;
+	double vals[8];
+	long long idxs[8];
+	__mmask8 tail, gt;
+	__m512d c, d, best = _mm512_set1_pd(-INFINITY);
+	__m512d vclk = _mm512_set1_pd(clk), ninf = _mm512_set1_pd(-INFINITY);
+	__m512i at = _mm512_set1_epi64(-1);
+	__m512i lanes = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+
+	for (m = 1; m <= size; m += 8) {
+		tail = (size - m >= 7) ? 0xff :
+				(__mmask8) ((1u << (size - m + 1)) - 1);
+		c = _mm512_maskz_loadu_pd(tail, clout + m);
+		ok = _mm512_mask_cmp_pd_mask(tail, c, ninf, _CMP_NEQ_OQ)
+				& _mm512_mask_cmplt_epi64_mask(tail,
+						_mm512_cvtepi32_epi64(_mm512_castsi512_si256(
+								_mm512_maskz_loadu_epi32((__mmask16) tail,
+										tabu + m))), _mm512_set1_epi64(1));
+		if (ok == 0)
+			continue;
+		d = _mm512_sub_pd(_mm512_sub_pd(c, vclk),
+				_mm512_maskz_loadu_pd(tail, row + m));
+		*evaluated += __builtin_popcount(ok);
+		gt = _mm512_mask_cmp_pd_mask((__mmask8) ok, d, best, _CMP_GT_OQ);
+		best = _mm512_mask_mov_pd(best, gt, d);
+		at = _mm512_mask_mov_epi64(at, gt,
+				_mm512_add_epi64(lanes, _mm512_set1_epi64(m)));
+	}
+	_mm512_storeu_pd(vals, best);
+	_mm512_storeu_si512(idxs, at);
+	*del = -INFINITY;
+	pos = -1;
+	for (lane = 0; lane < 8; lane++)
+		if (idxs[lane] >= 0 && (vals[lane] > *del
+				|| (vals[lane] == *del && idxs[lane] < pos))) {
+			*del = vals[lane];
+			pos = (int) idxs[lane];
+		}
+	return pos;
+}
+
+/* Distance rows.  row[j] accumulates (x_tj-x_tk)^2 over t=0..dim-1 and
+ is replaced by its square root; the products are rounded before they
+ are added, as in point_distance(). */
+
+static void dist_scalar(double *row, const double *x, long stride, int dim,
+		int k, int size) {
+	int j, t;
+	const double *xt;
+	double xk, d;
+
+	for (j = 1; j <= size; j++)
+		*(row + j) = 0.;
+	for (t = 0; t < dim; t++) {
+		xt = x + t * stride;
+		xk = *(xt + k);
+		for (j = 1; j <= size; j++) {
+			d = *(xt + j) - xk;
+			*(row + j) += d * d;
+		}
+	}
+	for (j = 1; j <= size; j++)
+		*(row + j) = sqrt(*(row + j));
+}
+
+__attribute__((target("avx2")))
+static void dist_avx2(double *row, const double *x, long stride, int dim,
+		int k, int size) {
+	int j, t;
+	const double *xt;
+	double xk, d;
+	__m256d vk, v;
+
+	for (j = 1; j <= size; j++)
+		*(row + j) = 0.;
+	for (t = 0; t < dim; t++) {
+		xt = x + t * stride;
+		xk = *(xt + k);
+		vk = _mm256_set1_pd(xk);
+		for (j = 1; j + 3 <= size; j += 4) {
+			v = _mm256_sub_pd(_mm256_loadu_pd(xt + j), vk);
+			_mm256_storeu_pd(row + j, _mm256_add_pd(_mm256_loadu_pd(row + j),
+					_mm256_mul_pd(v, v)));
+		}
+		for (; j <= size; j++) {
+			d = *(xt + j) - xk;
+			*(row + j) += d * d;
+		}
+	}
+	for (j = 1; j + 3 <= size; j += 4)
+		_mm256_storeu_pd(row + j, _mm256_sqrt_pd(_mm256_loadu_pd(row + j)));
+	for (; j <= size; j++)
+		*(row + j) = sqrt(*(row + j));
+}
+
+__attribute__((target("avx512f")))
+static void dist_avx512(double *row, const double *x, long stride, int dim,
+		int k, int size) {
+	int j, t;
+	const double *xt;
+	__mmask8 tail;
+	__m512d vk, v;
+
+	for (j = 1; j <= size; j++)
+		*(row + j) = 0.;
+	for (t = 0; t < dim; t++) {
+		xt = x + t * stride;
+		vk = _mm512_set1_pd(*(xt + k));
+		for (j = 1; j <= size; j += 8) {
+			tail = (size - j >= 7) ? 0xff :
+					(__mmask8) ((1u << (size - j + 1)) - 1);
+			v = _mm512_sub_pd(_mm512_maskz_loadu_pd(tail, xt + j), vk);
+			_mm512_mask_storeu_pd(row + j, tail,
+					_mm512_add_pd(_mm512_maskz_loadu_pd(tail, row + j),
+							_mm512_mul_pd(v, v)));
+		}
+	}
+	for (j = 1; j <= size; j += 8) {
+		tail = (size - j >= 7) ? 0xff :
+				(__mmask8) ((1u << (size - j + 1)) - 1);
+		_mm512_mask_storeu_pd(row + j, tail,
+				_mm512_sqrt_pd(_mm512_maskz_loadu_pd(tail, row + j)));
+	}
+}
+
+static const GainKernels kernels[3] = {
+		{ GAIN_KERNEL_SCALAR, "scalar", add_scalar, sub_scalar, swap_scalar,
+				scan_scalar, dist_scalar },
+		{ GAIN_KERNEL_AVX2, "avx2", add_avx2, sub_avx2, swap_avx2, scan_avx2,
+				dist_avx2 },
+		{ GAIN_KERNEL_AVX512, "avx512", add_avx512, sub_avx512, swap_avx512,
+				scan_avx512, dist_avx512 } };
+
+static const GainKernels *select_kernels(void) {
+	int kind = GAIN_KERNEL_SCALAR;
+	const char *env;
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		kind = GAIN_KERNEL_AVX512;
+	else if (__builtin_cpu_supports("avx2"))
+		kind = GAIN_KERNEL_AVX2;
+	env = getenv("ITS_SIMD");
+	if (env != NULL) {
+		if (strcmp(env, "scalar") == 0)
+			kind = GAIN_KERNEL_SCALAR;
+		else if (strcmp(env, "avx2") == 0 && kind >= GAIN_KERNEL_AVX2)
+			kind = GAIN_KERNEL_AVX2;
+	}
+	return &kernels[kind];
+}
+
+static const GainKernels *gain_kernels(void) {
+	static const GainKernels *selected = select_kernels();
+	return selected;
+}
+
+int gain_kernel_kind(void) {
+	return gain_kernels()->kind;
+}
+
+const char *gain_kernel_name(void) {
+	return gain_kernels()->name;
+}
+
+/* The kernels run over all of 1..size; the gain of the moved vertex
+ itself is then put back to what the original loops (which skipped
+ j == ind) left there. */
+
+void gain_add(double *cl, const double *row, int size, int ind) {
+	double keep = *(cl + ind);
+	gain_kernels()->add(cl, row, size);
+	*(cl + ind) = keep;
+}
+
+void gain_sub(double *cl, const double *row, int size, int ind) {
+	double keep = *(cl + ind);
+	gain_kernels()->sub(cl, row, size);
+	*(cl + ind) = keep;
+}
+
+void gain_swap(double *cl, const double *row1, const double *row2, int size,
+		int ind1, int ind2, int fused) {
+	double keep1 = *(cl + ind1), keep2 = *(cl + ind2);
+	gain_kernels()->swap(cl, row1, row2, size, fused);
+	*(cl + ind1) = keep1 + *(row2 + ind1);
+	*(cl + ind2) = keep2 - *(row1 + ind2);
+}
+
+void gain_add_part(double *cl, const double *row, int lo, int hi) {
+	gain_kernels()->add(cl + lo - 1, row + lo - 1, hi - lo + 1);
+}
+
+void gain_sub_part(double *cl, const double *row, int lo, int hi) {
+	gain_kernels()->sub(cl + lo - 1, row + lo - 1, hi - lo + 1);
+}
+
+void gain_swap_part(double *cl, const double *row1, const double *row2,
+		int lo, int hi, int fused) {
+	gain_kernels()->swap(cl + lo - 1, row1 + lo - 1, row2 + lo - 1,
+			hi - lo + 1, fused);
+}
+
+int swap_scan(const double *clout, const double *row, const int *tabu,
+		int size, double clk, double *del, long *evaluated) {
+	return gain_kernels()->scan(clout, row, tabu, size, clk, del, evaluated);
+}
+
+void distance_row(double *row, const double *x, long stride, int dim,
+		int k, int size) {
+	gain_kernels()->dist(row, x, stride, dim, k, size);
+}
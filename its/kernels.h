@@ -0,0 +1,49 @@
+/* Vector kernels for the gain (cl) updates of ITS.
+ After a vertex ind enters (leaves) the solution, every other gain
+ changes by +c_ind,j (-c_ind,j); a swap of ind1 out and ind2 in changes
+ cl_j by -c_ind1,j+c_ind2,j.  The kernels below apply these updates to
+ the contiguous gain array cl[1..size] from contiguous weight rows.
+ An AVX-512, AVX2 or scalar implementation is picked on first use
+ according to the processor; setting the environment variable ITS_SIMD
+ to "scalar", "avx2" or "avx512" overrides the choice.
+ With fused == 0 a swap is applied as (cl-c_ind1,j)+c_ind2,j, which
+ rounds exactly as the scalar loops did, so all implementations give
+ bit-identical gains.  With fused != 0 it is applied as
+ cl+(c_ind2,j-c_ind1,j), which is faster but rounds differently.
+ swap_scan() evaluates the swap neighborhood of one in-set vertex k of
+ tabu_search with the same dispatch.  It reads the gains of the
+ out-of-set vertices from a copy of cl in which in-set vertices are
+ masked by -INFINITY, together with the weight row of k and a mask that
+ is nonzero for the vertices forming a tabu pair with k, all contiguous
+ and indexed 1..size.  It returns the candidate m with the largest
+ change del = cl_m-cl_k-c_km, the first one in index order, with del in
+ *del, or -1 if there is none; all implementations make the same
+ comparisons as the scalar loop, so the move chosen does not depend on
+ the implementation.
+ The _part variants apply an update to cl[lo..hi] only and leave the
+ moved vertices to the caller, for splitting one update across threads.
+ distance_row() gives the weight row of vertex k for instances given by
+ point coordinates: the Euclidean distances from point k to points
+ 1..size, with coordinate t of point j at x[t*stride+j].  The squares
+ are summed in the order of the coordinates and no implementation fuses
+ the multiplications, so the distances are those of point_distance()
+ in 'ITS.h', bit for bit. */
+
+#define GAIN_KERNEL_SCALAR           0
+#define GAIN_KERNEL_AVX2             1
+#define GAIN_KERNEL_AVX512           2
+
+int gain_kernel_kind(void);
+const char *gain_kernel_name(void);
+void gain_add(double *cl, const double *row, int size, int ind);
+void gain_sub(double *cl, const double *row, int size, int ind);
+void gain_swap(double *cl, const double *row1, const double *row2, int size,
+		int ind1, int ind2, int fused);
+void gain_add_part(double *cl, const double *row, int lo, int hi);
+void gain_sub_part(double *cl, const double *row, int lo, int hi);
+void gain_swap_part(double *cl, const double *row1, const double *row2,
+		int lo, int hi, int fused);
+void distance_row(double *row, const double *x, long stride, int dim,
+		int k, int size);
+int swap_scan(const double *clout, const double *row, const int *tabu,
+		int size, double clk, double *del, long *evaluated);
@@ -0,0 +1,282 @@
+/* Loader for instances in the triplet format, see 'loader.h'. */
+
+#include <charconv>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "loader.h"
+
+/* One byte range of the triplets, parsed by one thread. */
+typedef struct
+     {TripletFile *pf;
+      size_t lo, hi;      /* triplets whose line starts in [lo,hi)            */
+      triplet_sink sink;
+      void *ctx;
+      long count;         /* triplets parsed, or -1 on a syntax error         */
+      int joined;         /* 1 if parsed by a thread of its own               */
+     }LoadRange;
+
+static const char *skip_blanks(const char *p, const char *end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+	return p;
+}
+
+/* Parses a non-negative integer; returns NULL if there is none. */
+static const char *parse_int(const char *p, const char *end, int *value) {
+	long v = 0;
+
+	p = skip_blanks(p, end);
+	if (p == end || *p < '0' || *p > '9')
+		return NULL;
+	while (p < end && *p >= '0' && *p <= '9') {
+		v = 10 * v + (*p - '0');
+		if (v > 0x7fffffff)
+			return NULL;
+		p++;
+	}
+	*value = (int) v;
+	return p;
+}
+
+static const char *parse_double(const char *p, const char *end, double *value) {
+	std::from_chars_result r;
+
+	p = skip_blanks(p, end);
+	if (p < end && *p == '+')
+		p++;
+	r = std::from_chars(p, end, *value);
+	if (r.ec != std::errc())
+		return NULL;
+	return r.ptr;
+}
+
+int triplets_open(const char *file_name, TripletFile *pf) {
+	int fd;
+	struct stat st;
+	const char *p, *end;
+	void *data;
+
+	if ((fd = open(file_name, O_RDONLY)) < 0)
+		return -1;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return -1;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return -1;
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+	pf->data = (const char *) data;
+	pf->length = st.st_size;
+	end = pf->data + pf->length;
+	p = parse_int(pf->data, end, &pf->size);
+	if (p == NULL || pf->size < 2) {
+		triplets_close(pf);
+		return -1;
+	}
+	pf->second = -1;
+	p = skip_blanks(p, end);
+	if (p < end && *p != '\n'
+			&& (p = parse_int(p, end, &pf->second)) == NULL) {
+		triplets_close(pf);
+		return -1;
+	}
+	p = skip_blanks(p, end);
+	if (p < end && *p != '\n') {
+		triplets_close(pf);
+		return -1;
+	}
+	pf->body = p < end ? p - pf->data + 1 : pf->length;
+	return 0;
+}
+
+static void *load_range(void *arg) {
+	LoadRange *pr = (LoadRange *) arg;
+	TripletFile *pf = pr->pf;
+	const char *p, *q, *end = pf->data + pf->length;
+	const char *hi = pf->data + pr->hi;
+	int i, j;
+	double w;
+
+	p = pf->data + pr->lo;
+	/* a range owns the lines starting in it */
+	if (pr->lo > pf->body)
+		while (p < end && *(p - 1) != '\n')
+			p++;
+	pr->count = 0;
+	while (p < hi) {
+		q = skip_blanks(p, end);
+		if (q < end && *q == '\n') {
+			p = q + 1;
+			continue;
+		}
+		if (q == end)
+			break;
+		if ((q = parse_int(q, end, &i)) == NULL
+				|| (q = parse_int(q, end, &j)) == NULL
+				|| (q = parse_double(q, end, &w)) == NULL
+				|| i >= pf->size || j >= pf->size || i == j) {
+			pr->count = -1;
+			return NULL;
+		}
+		q = skip_blanks(q, end);
+		if (q < end && *q != '\n') {
+			pr->count = -1;
+			return NULL;
+		}
+		pr->sink(pr->ctx, i, j, w);
+		(pr->count)++;
+		p = q + 1;
+	}
+	return NULL;
+}
+
+/* Parses the triplets with up to threads threads; returns their number,
+ or -1 if the file is malformed. */
+long triplets_read(TripletFile *pf, int threads, triplet_sink sink,
+		void *ctx) {
+	LoadRange *pr;
+	pthread_t *tids;
+	size_t bytes = pf->length - pf->body;
+	long count = 0;
+	int t;
+
+	if (threads > (long) (bytes / LOAD_MIN_SPLIT))
+		threads = bytes / LOAD_MIN_SPLIT;
+	if (threads < 1)
+		threads = 1;
+	pr = (LoadRange *) calloc(threads, sizeof(LoadRange));
+	tids = (pthread_t *) calloc(threads, sizeof(pthread_t));
+	if (pr == NULL || tids == NULL) {
+		free(pr);
+		free(tids);
+		return -1;
+	}
+	for (t = 0; t < threads; t++) {
+		(pr + t)->pf = pf;
+		(pr + t)->lo = pf->body + bytes * t / threads;
+		(pr + t)->hi = pf->body + bytes * (t + 1) / threads;
+		(pr + t)->sink = sink;
+		(pr + t)->ctx = ctx;
+	}
+	for (t = 1; t < threads; t++)
+		(pr + t)->joined = pthread_create(tids + t, NULL, load_range,
+				pr + t) == 0;
+	load_range(pr);
+	for (t = 1; t < threads; t++)
+		if ((pr + t)->joined)
+			pthread_join(*(tids + t), NULL);
+		else
+			load_range(pr + t);
+	for (t = 0; t < threads; t++) {
+		if ((pr + t)->count < 0) {
+			count = -1;
+			break;
+		}
+		count += (pr + t)->count;
+	}
+	free(pr);
+	free(tids);
+	return count;
+}
+
+/* Parses the points of a point file opened by triplets_open(), each with
+ dim coordinates; coordinate t of point i (1-based) goes to
+ coords[t*stride+i].  Returns 0, or -1 if the file is malformed. */
+int points_read(TripletFile *pf, int dim, double *coords, long stride) {
+	const char *p = pf->data + pf->body, *end = pf->data + pf->length;
+	int i = 1, t;
+
+	while (p < end && i <= pf->size) {
+		p = skip_blanks(p, end);
+		if (p < end && *p == '\n') {
+			p++;
+			continue;
+		}
+		if (p == end)
+			break;
+		for (t = 0; t < dim; t++)
+			if ((p = parse_double(p, end, coords + t * stride + i)) == NULL)
+				return -1;
+		p = skip_blanks(p, end);
+		if (p < end && *p != '\n')
+			return -1;
+		p++;
+		i++;
+	}
+	return i > pf->size ? 0 : -1;
+}
+
+void triplets_close(TripletFile *pf) {
+	munmap((void *) pf->data, pf->length);
+	pf->data = NULL;
+}
+
+/* Maps a binary instance; returns 0 on success, 1 if the file is not a
+ binary instance (or cannot be opened; it is then left to the text
+ loader) and -1 if it is a damaged or foreign one. */
+int binary_open(const char *file_name, BinaryFile *pb) {
+	int fd;
+	struct stat st;
+	BinaryHeader *ph;
+
+	if ((fd = open(file_name, O_RDONLY)) < 0)
+		return 1;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+	if (st.st_size < BINARY_HEADER_SIZE) {
+		close(fd);
+		return 1;
+	}
+	pb->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (pb->map == MAP_FAILED)
+		return -1;
+	pb->length = st.st_size;
+	ph = (BinaryHeader *) pb->map;
+	if (memcmp(ph->magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0) {
+		binary_close(pb);
+		return 1;
+	}
+	if (ph->order != BINARY_ORDER || ph->size < 2 || ph->bytes < 0
+			|| (size_t) ph->bytes > pb->length - BINARY_HEADER_SIZE) {
+		binary_close(pb);
+		return -1;
+	}
+	pb->header = *ph;
+	pb->payload = (char *) pb->map + BINARY_HEADER_SIZE;
+	return 0;
+}
+
+void binary_close(BinaryFile *pb) {
+	munmap(pb->map, pb->length);
+	pb->map = NULL;
+}
+
+/* Writes a binary instance; returns 0 on success. */
+int binary_write(const char *file_name, const BinaryHeader *ph,
+		const void *payload) {
+	FILE *f;
+	BinaryHeader header = *ph;
+	int ok;
+
+	memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+	header.order = BINARY_ORDER;
+	memset(header.pad, 0, sizeof(header.pad));
+	if ((f = fopen(file_name, "wb")) == NULL)
+		return -1;
+	ok = fwrite(&header, sizeof(header), 1, f) == 1
+			&& fwrite(payload, 1, header.bytes, f) == (size_t) header.bytes;
+	if (fclose(f) != 0)
+		ok = 0;
+	return ok ? 0 : -1;
+}
@@ -0,0 +1,79 @@
+/* Loader for instances in the triplet format:
+ the size n, optionally followed on the same line by a second number
+ (the subset size of the GKD/MDG files, which is ignored), and then a
+ triplet "i j c_ij" with 0-based i and j for every pair of vertices.
+ The file is mapped into memory and parsed in place: integers by hand,
+ weights by std::from_chars.  The triplets may be parsed by several
+ threads, each taking a range of bytes of the file; they are passed to
+ a sink function which is then called from all of these threads, so it
+ must only write locations belonging to the pair (i,j).
+ Usage: triplets_open(), allocate the matrix for pf->size vertices,
+ triplets_read(), triplets_close().
+ Instances may also be kept in a binary file: a BinaryHeader of
+ BINARY_HEADER_SIZE bytes followed by the weights exactly as ITS keeps
+ them in memory (see Weights in 'ITS.h'), so that binary_open() can map
+ the file and the solver can use the mapped payload as it is.  The
+ payload starts BINARY_HEADER_SIZE bytes into the file, which keeps it
+ aligned to WEIGHT_ALIGN.  Byte order and sizes are those of the machine
+ that wrote the file; binary_open() rejects files written otherwise.
+ Instances whose weights are the Euclidean distances between points may
+ be given by the coordinates instead, in a point file: the size n and
+ the dimension d on the first line, then the d coordinates of each of
+ the n points on a line of its own.  It is opened by triplets_open(),
+ which reads d as the second number, and parsed by points_read(). */
+
+#include <stddef.h>
+
+#define WEIGHTS_DENSE            0  /* full matrix of doubles            */
+#define WEIGHTS_PACKED_FLOAT     1  /* upper triangle of floats          */
+#define WEIGHTS_PACKED_DOUBLE    2  /* upper triangle of doubles         */
+#define WEIGHTS_SPARSE           3  /* adjacency lists of the nonzero    */
+                                    /* weights; text instances only     */
+#define WEIGHTS_POINTS           4  /* point coordinates, the distances  */
+                                    /* computed when needed; point      */
+                                    /* files only                       */
+
+#define LOAD_MIN_SPLIT        (1L<<22)  /* bytes of triplets per thread     */
+#define BINARY_MAGIC         "MDPBIN1"
+#define BINARY_ORDER        0x01020304  /* byte order check                 */
+#define BINARY_HEADER_SIZE          64
+#define WEIGHT_ALIGN                64  /* bytes; one cache line            */
+
+typedef void (*triplet_sink)(void *ctx, int i, int j, double w);
+
+typedef struct
+     {const char *data;   /* mapped file                                      */
+      size_t length;      /* its length in bytes                              */
+      size_t body;        /* offset of the first triplet                      */
+      int size;           /* n from the header                                */
+      int second;         /* second number of the header, or -1               */
+     }TripletFile;
+
+int triplets_open(const char *file_name, TripletFile *pf);
+long triplets_read(TripletFile *pf, int threads, triplet_sink sink,
+		void *ctx);
+void triplets_close(TripletFile *pf);
+int points_read(TripletFile *pf, int dim, double *coords, long stride);
+
+typedef struct
+     {char magic[8];      /* BINARY_MAGIC                                     */
+      int order;          /* BINARY_ORDER                                     */
+      int size;           /* graph order n                                    */
+      int second;         /* second number of the text header, or -1          */
+      int kind;           /* storage kind, one of WEIGHTS_*                   */
+      long stride;        /* WEIGHTS_DENSE: entries per row, else 0           */
+      long bytes;         /* length of the payload in bytes                   */
+      char pad[BINARY_HEADER_SIZE-40];
+     }BinaryHeader;
+
+typedef struct
+     {void *map;          /* mapped file                                      */
+      size_t length;      /* its length in bytes                              */
+      BinaryHeader header;
+      void *payload;      /* the weights, inside map                          */
+     }BinaryFile;
+
+int binary_open(const char *file_name, BinaryFile *pb);
+void binary_close(BinaryFile *pb);
+int binary_write(const char *file_name, const BinaryHeader *ph,
+		const void *payload);
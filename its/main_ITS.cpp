@@ -1,70 +1,234 @@
+#include <math.h>
 #include <memory.h>
 //#include <process.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#define	CLK_TCK		CLOCKS_PER_SEC
-
-typedef struct {
-	int *sol; /* solution obtained                                */
-	double value; /* its value                                        */
-	long time_to_opt; /* time to solution, secs                           */
-	long total_time; /* total time, secs                                 */
-	long characts[10]; /* some characteristics:                            */
-	/*    characts[0] - graph order                     */
-	/*    characts[1] - time limit                      */
-	/*    characts[2] - number of starts executed       */
-	/*    characts[3] - number of solution improvements */
-	/*    characts[4] - start no. for the last          */
-	/*                  improvement                     */
-	/*    characts[5] - lower bound on subgraph's size  */
-	/*    characts[6] - upper bound on subgraph's size  */
-	/*    characts[7] - subgraph's size                 */
-} Results;
-
-void ITS(char *, char *, int, int, double, long, long, Results *);
+#include <unistd.h>
+#include <pthread.h>
+#include "ITS.h"
+
+#define MAX_RUNS                    10
+#define TTT_GAPS                     4  /* default targets of the time-to-   */
+                                        /* target file, as relative gaps    */
+                                        /* below the best value found       */
+
+/* One run of the benchmark, executed by one of the worker threads. */
+typedef struct
+     {char out_file[80];  /* output file of the run                           */
+      double seed;        /* seed of the run                                  */
+      Results res;        /* results of the run                               */
+      int status;         /* of ITS_coop()                                    */
+     }Job;
+
+typedef struct
+     {Weights *pweight;   /* instance shared by all runs, read only           */
+      Job *jobs;          /* runs 1..count                                    */
+      int count;          /* number of runs                                   */
+      int next;           /* next run to be taken by a worker                 */
+      int b1, b2;         /* bounds on the subgraph's size                    */
+      int workers;        /* cooperating runs per seed                        */
+      int scan_threads;   /* threads splitting the scans of one run           */
+      int swap_cand;      /* length of the swap candidate lists, 0 - off      */
+      int rng_kind;       /* random number generator, one of RNG_*            */
+      int trace_size;     /* points of the convergence trace, 0 - off         */
+      long iterations_coef;
+      const Limits *plimits;
+     }Pool;
+
+static void *worker(void *arg) {
+	Pool *pool = (Pool *) arg;
+	Job *job;
+	int i;
+
+	while ((i = __sync_add_and_fetch(&pool->next, 1)) <= pool->count) {
+		job = pool->jobs + i;
+		job->status = ITS_coop(pool->pweight, job->out_file, pool->b1,
+				pool->b2, job->seed, pool->iterations_coef, pool->plimits,
+				pool->workers, pool->scan_threads, pool->swap_cand,
+				pool->rng_kind, pool->trace_size, &job->res);
+	}
+	return NULL;
+}
+
+static int compare_times(const void *a, const void *b) {
+	double ta = *(const double *) a, tb = *(const double *) b;
+
+	return ta < tb ? -1 : ta > tb;
+}
+
+/* Writes the time-to-target distribution of the traced runs 1..count as
+ CSV lines "target,rank,time_s,probability": for every target, the times
+ at which the runs reaching it first did so, sorted, with the empirical
+ probability (rank-0.5)/count of reaching it by then. The targets are
+ the one set with -v or, failing that, the best value of all runs less
+ 0, 0.1, 0.5 and 1 percent of its magnitude. Returns 0 on success. */
+static int write_ttt(const char *file_name, const Job *jobs, int count,
+		const Limits *plimits) {
+	static const double gaps[TTT_GAPS] = { 0., 0.001, 0.005, 0.01 };
+	FILE *f;
+	const Results *pres;
+	double targets[TTT_GAPS];
+	double times[MAX_RUNS + 1];
+	double best = -INFINITY;
+	int i, j, t, reached, target_count;
+
+	for (i = 1; i <= count; i++)
+		if (jobs[i].res.value > best)
+			best = jobs[i].res.value;
+	if (plimits->has_target) {
+		targets[0] = plimits->target;
+		target_count = 1;
+	} else {
+		for (t = 0; t < TTT_GAPS; t++)
+			targets[t] = best - gaps[t] * fabs(best);
+		target_count = TTT_GAPS;
+	}
+	if ((f = fopen(file_name, "w")) == NULL)
+		return -1;
+	fprintf(f, "target,rank,time_s,probability\n");
+	for (t = 0; t < target_count; t++) {
+		reached = 0;
+		for (i = 1; i <= count; i++) {
+			pres = &jobs[i].res;
+			for (j = 0; j < pres->trace_count; j++)
+				if ((pres->trace + j)->value >= targets[t] - 0.00001) {
+					times[reached++] = (pres->trace + j)->us / 1e6;
+					break;
+				}
+		}
+		qsort(times, reached, sizeof(double), compare_times);
+		for (i = 0; i < reached; i++)
+			fprintf(f, "%.6lf,%d,%.6lf,%.4lf\n", targets[t], i + 1, times[i],
+					(i + 0.5) / count);
+	}
+	return fclose(f) == 0 ? 0 : -1;
+}
 
 int main(int argc, char **argv) {
-	long start = clock();
+	double start = clock_ms();
 
 	FILE *out;
-	Results *pres;
+	Weights weights;
+	Job jobs[MAX_RUNS + 1];
+	Pool pool;
+	pthread_t threads[MAX_RUNS];
+	int thread_count = 0;
+	int workers = 1;
+	int scan_threads = 1;
+	int swap_cand = 0;
+	int rng_kind = RNG_DEFAULT;
+	int trace_size = 0;
+	char ttt_file_name[96];
 	char in_file_name[80];
 	char out_file_name[80];
 	char summary_file_name[80];
 	int i, j;
+	int status;
 	int b1, b2;
 	int count;
 	int sind;
-	long time_limit;
 	long iterations_coef;
 	double seeds[11] = { 0, 1000, 2000, 3000, 4000, 5000, 6000, 7000, 8000,
 			9000, 10000 };
-	char out_file[80];
+	char out_file[80] = { 0 };
 	char numbs[31][2] = { { '0' }, { '1' }, { '2' }, { '3' }, { '4' }, { '5' },
 			{ '6' }, { '7' }, { '8' }, { '9' }, { '1', '0' } };
 	double av_value = 0., av_time = 0.;
+	int storage = WEIGHTS_DENSE;
+	int c;
+	Limits limits;
 
-	if (argc <= 3) {
+	limits.time_ms = 1000.;
+	limits.iterations = 0;
+	limits.target = 0.;
+	limits.has_target = 0;
+	/* bounds on the subgraph's size, -b b1[,b2]; b2=b1 if omitted */
+	b1 = 30;
+	b2 = 30;
+	while ((c = getopt(argc, argv, "b:s:t:i:v:j:p:w:c:r:T:")) != -1) {
+		switch (c) {
+		case 'b':
+			j = sscanf(optarg, "%d,%d", &b1, &b2);
+			if (j == 1)
+				b2 = b1;
+			if (j < 1 || b1 < 1 || b2 < b1) {
+				printf("  invalid bounds %s (b1[,b2], 1<=b1<=b2)", optarg);
+				exit(1);
+			}
+			break;
+		case 'j':
+			thread_count = atoi(optarg);
+			break;
+		case 'p':
+			workers = atoi(optarg);
+			break;
+		case 'w':
+			scan_threads = atoi(optarg);
+			break;
+		case 'c':
+			swap_cand = atoi(optarg);
+			break;
+		case 'T':
+			trace_size = atoi(optarg);
+			break;
+		case 't':
+			limits.time_ms = atof(optarg);
+			break;
+		case 'i':
+			limits.iterations = atol(optarg);
+			break;
+		case 'v':
+			limits.target = atof(optarg);
+			limits.has_target = 1;
+			break;
+		case 'r':
+			if (strcmp(optarg, "xoshiro") == 0)
+				rng_kind = RNG_XOSHIRO;
+			else if (strcmp(optarg, "legacy") == 0)
+				rng_kind = RNG_LEGACY;
+			else {
+				printf("  unknown generator %s (xoshiro or legacy)", optarg);
+				exit(1);
+			}
+			break;
+		case 's':
+			if (strcmp(optarg, "dense") == 0)
+				storage = WEIGHTS_DENSE;
+			else if (strcmp(optarg, "float") == 0)
+				storage = WEIGHTS_PACKED_FLOAT;
+			else if (strcmp(optarg, "double") == 0)
+				storage = WEIGHTS_PACKED_DOUBLE;
+			else if (strcmp(optarg, "sparse") == 0)
+				storage = WEIGHTS_SPARSE;
+			else if (strcmp(optarg, "points") == 0)
+				storage = WEIGHTS_POINTS;
+			else {
+				printf("  unknown storage %s (dense, float, double, sparse or "
+						"points)", optarg);
+				exit(1);
+			}
+			break;
+		default:
+			exit(1);
+		}
+	}
+	if (argc - optind < 3) {
 		printf("  specify data and output files");
 		exit(1);
 	}
-	strcpy(in_file_name, argv[1]);
-	strcpy(out_file_name, argv[2]);
-	strcpy(summary_file_name, argv[3]);
-	pres = (Results *) calloc(1, sizeof(Results));
+	strcpy(in_file_name, argv[optind]);
+	strcpy(out_file_name, argv[optind + 1]);
+	strcpy(summary_file_name, argv[optind + 2]);
 	if ((out = fopen(summary_file_name, "w")) == NULL) {
 		printf("  fopen failed for output  %s", summary_file_name);
 		exit(1);
 	}
-	sind = strlen(argv[2]) - 1;
+	sind = strlen(argv[optind + 1]) - 1;
 
 	iterations_coef = 1000;
-	time_limit = (long) 1;
-	b1 = 30;
-	b2 = 30;
-	count = 10;
+	count = MAX_RUNS;
 	int pos_ponto;
 	for (i = 1; i <= count; i++) {
 
@@ -94,20 +258,83 @@ int main(int argc, char **argv) {
 			out_file[sind + 1] = numbs[i][0];
 			out_file[sind + 2] = numbs[i][1];
 		}*/
-		ITS(in_file_name, out_file, b1, b2, seeds[i], iterations_coef,
-				time_limit, pres);
-		fprintf(out, "    %11.3lf       %8ld\n", pres->value,
-				pres->time_to_opt);
-		av_value += pres->value;
-		av_time += pres->time_to_opt;
+		strcpy(jobs[i].out_file, out_file);
+		jobs[i].seed = seeds[i];
+		memset(&jobs[i].res, 0, sizeof(Results));
+	}
+
+	/* the instance is read once; the runs go to a pool of threads, each
+	 with its own search state over the shared weights; with -p each run
+	 is itself made of that many cooperating threads, and with -w each of
+	 these splits its scans across that many threads; -c restricts the
+	 swap moves to candidate lists of the given length, and -T records
+	 a convergence trace of that many points per run (see 'trace.h') */
+	if (workers < 1)
+		workers = 1;
+	if (scan_threads < 1)
+		scan_threads = 1;
+	if (thread_count <= 0)
+		thread_count = sysconf(_SC_NPROCESSORS_ONLN) / workers / scan_threads;
+	if (thread_count > count)
+		thread_count = count;
+	if (thread_count < 1)
+		thread_count = 1;
+	status = ITS_load(in_file_name, storage,
+			thread_count * workers * scan_threads, &weights);
+	if (status != ITS_OK) {
+		printf("  %s: %s", ITS_error(status), in_file_name);
+		exit(1);
+	}
+	pool.pweight = &weights;
+	pool.jobs = jobs;
+	pool.count = count;
+	pool.next = 0;
+	pool.b1 = b1;
+	pool.b2 = b2;
+	pool.workers = workers;
+	pool.scan_threads = scan_threads;
+	pool.swap_cand = swap_cand;
+	pool.rng_kind = rng_kind;
+	pool.trace_size = trace_size;
+	pool.iterations_coef = iterations_coef;
+	pool.plimits = &limits;
+	for (i = 1; i < thread_count; i++)
+		if (pthread_create(&threads[i], NULL, worker, &pool) != 0) {
+			printf("  pthread_create failed");
+			exit(1);
+		}
+	worker(&pool);
+	for (i = 1; i < thread_count; i++)
+		pthread_join(threads[i], NULL);
+	free_weights(&weights);
+	for (i = 1; i <= count; i++)
+		if (jobs[i].status != ITS_OK) {
+			printf("  %s: %s", ITS_error(jobs[i].status), jobs[i].out_file);
+			exit(1);
+		}
+
+	for (i = 1; i <= count; i++) {
+		fprintf(out, "    %11.3lf       %12.6lf\n", jobs[i].res.value,
+				jobs[i].res.time_to_opt);
+		av_value += jobs[i].res.value;
+		av_time += jobs[i].res.time_to_opt;
 	}
 	av_value /= count;
 	av_time /= count;
 	fprintf(out, "     %11.3lf    %11.3lf\n", av_value, av_time);
+	if (trace_size > 0) {
+		snprintf(ttt_file_name, sizeof(ttt_file_name), "%s.ttt.csv",
+				summary_file_name);
+		if (write_ttt(ttt_file_name, jobs, count, &limits) != 0)
+			printf("  failed to write %s\n", ttt_file_name);
+	}
+	for (i = 1; i <= count; i++) {
+		free(jobs[i].res.sol);
+		free(jobs[i].res.trace);
+	}
 
 
-	long end = clock();
-	long elapsed_time = (long) (end - start) / CLK_TCK;
+	long elapsed_time = (long) ((clock_ms() - start) / 1000.);
 	fprintf(out, "elapsed time:  %ld\n", elapsed_time);
 	fclose(out);
 	return 0;
@@ -0,0 +1,98 @@
+/* Persistent thread pool, see 'parallel.h'. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ITS.h"
+
+/* Takes and runs parts of the current job until none is left. Called
+ with the lock held; returns with it held. */
+static void par_work(ParPool *pp) {
+	int part;
+
+	while (pp->next < pp->parts) {
+		part = (pp->next)++;
+		pthread_mutex_unlock(&pp->lock);
+		pp->task(pp->ctx, part);
+		pthread_mutex_lock(&pp->lock);
+		if (++(pp->finished) == pp->parts)
+			pthread_cond_broadcast(&pp->done);
+	}
+}
+
+static void *par_thread(void *arg) {
+	ParPool *pp = (ParPool *) arg;
+	long job = 0;
+
+	pthread_mutex_lock(&pp->lock);
+	for (;;) {
+		while (pp->job == job && pp->quit == 0)
+			pthread_cond_wait(&pp->go, &pp->lock);
+		if (pp->quit)
+			break;
+		job = pp->job;
+		par_work(pp);
+	}
+	pthread_mutex_unlock(&pp->lock);
+	return NULL;
+}
+
+/* Returns ITS_OK, or an error with the threads started so far in
+ pp->threads; the pool is to be freed by par_free() either way. */
+int par_init(int threads, ParPool *pp) {
+	int i;
+
+	if (threads < 1)
+		threads = 1;
+	pp->job = 0;
+	pp->parts = pp->next = pp->finished = 0;
+	pp->quit = 0;
+	pthread_mutex_init(&pp->lock, NULL);
+	pthread_cond_init(&pp->go, NULL);
+	pthread_cond_init(&pp->done, NULL);
+	pp->tids = NULL;
+	pp->threads = 1;
+	ALR(pp->tids, pthread_t, threads)
+	for (i = 1; i < threads; i++) {
+		if (pthread_create(pp->tids + i, NULL, par_thread, pp) != 0)
+			return ITS_ERR_THREAD;
+		pp->threads = i + 1;
+	}
+	return ITS_OK;
+}
+
+void par_free(ParPool *pp) {
+	int i;
+
+	pthread_mutex_lock(&pp->lock);
+	pp->quit = 1;
+	pthread_cond_broadcast(&pp->go);
+	pthread_mutex_unlock(&pp->lock);
+	for (i = 1; i < pp->threads; i++)
+		pthread_join(*(pp->tids + i), NULL);
+	pthread_cond_destroy(&pp->done);
+	pthread_cond_destroy(&pp->go);
+	pthread_mutex_destroy(&pp->lock);
+	free(pp->tids);
+}
+
+void par_run(ParPool *pp, par_task task, void *ctx, int parts) {
+	int part;
+
+	if (pp->threads == 1 || parts == 1) {
+		for (part = 0; part < parts; part++)
+			task(ctx, part);
+		return;
+	}
+	pthread_mutex_lock(&pp->lock);
+	pp->task = task;
+	pp->ctx = ctx;
+	pp->parts = parts;
+	pp->next = 0;
+	pp->finished = 0;
+	(pp->job)++;
+	pthread_cond_broadcast(&pp->go);
+	par_work(pp);
+	while (pp->finished < pp->parts)
+		pthread_cond_wait(&pp->done, &pp->lock);
+	pthread_mutex_unlock(&pp->lock);
+}
@@ -0,0 +1,30 @@
+/* Persistent thread pool for splitting one step of a search into parts.
+ par_run() runs task(ctx, part) for part=0..parts-1 on the threads of the
+ pool and on the calling thread, and returns when all parts are done.
+ Parts are taken in no particular order, so a task must write its
+ results into a slot of its own and the caller must combine them in part
+ order afterwards; done that way, the result does not depend on the
+ number of threads. */
+
+#include <pthread.h>
+
+typedef void (*par_task)(void *ctx, int part);
+
+typedef struct
+     {int threads;        /* threads of the pool, the caller included         */
+      pthread_t *tids;    /* threads 1..threads-1                             */
+      pthread_mutex_t lock;
+      pthread_cond_t go;  /* signalled when a new job is posted               */
+      pthread_cond_t done;/* signalled when the last part of a job is done    */
+      long job;           /* number of the current job                        */
+      par_task task;      /* current job                                      */
+      void *ctx;
+      int parts;          /* parts of the current job                         */
+      int next;           /* next part to be taken                            */
+      int finished;       /* parts of the current job done                    */
+      int quit;           /* 1 when the pool is being freed                   */
+     }ParPool;
+
+int par_init(int threads, ParPool *pp);
+void par_free(ParPool *pp);
+void par_run(ParPool *pp, par_task task, void *ctx, int parts);
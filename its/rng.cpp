@@ -0,0 +1,54 @@
+/* Random number generators of ITS, see 'rng.h'. */
+
+#include "rng.h"
+
+static uint64_t splitmix64(uint64_t *x) {
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+void rng_seed(Rng *pr, int kind, double seed) {
+	uint64_t x = (uint64_t) (int64_t) seed;
+	int i;
+
+	pr->kind = kind;
+	pr->seed = seed;
+	for (i = 0; i < 4; i++)
+		*(pr->s + i) = splitmix64(&x);
+}
+
+void rng_jump(Rng *pr) {
+	static const uint64_t jump[] = { 0x180ec6d33cfd0abaULL,
+			0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL,
+			0x39abdc4529b1661cULL };
+	uint64_t t[4] = { 0, 0, 0, 0 };
+	int i, b, k;
+
+	if (pr->kind == RNG_LEGACY)
+		return;
+	for (i = 0; i < 4; i++)
+		for (b = 0; b < 64; b++) {
+			if (jump[i] & (1ULL << b))
+				for (k = 0; k < 4; k++)
+					t[k] ^= *(pr->s + k);
+			rng_next(pr);
+		}
+	for (k = 0; k < 4; k++)
+		*(pr->s + k) = t[k];
+}
+
+/* Sets *pr to stream number stream (0, 1, ...) of master: master jumped
+ stream times, or for RNG_LEGACY the seed multiplied by stream+1. */
+void rng_stream(const Rng *master, int stream, Rng *pr) {
+	int i;
+
+	*pr = *master;
+	if (pr->kind == RNG_LEGACY) {
+		pr->seed = (stream + 1) * master->seed;
+		return;
+	}
+	for (i = 0; i < stream; i++)
+		rng_jump(pr);
+}
@@ -0,0 +1,55 @@
+/* Random number generators of ITS.
+ RNG_XOSHIRO is xoshiro256** (Blackman and Vigna), seeded from one number
+ through splitmix64.  rng_jump() advances it by 2^128 steps, so streams
+ obtained from one seed by successive jumps never overlap in any run of
+ realistic length: the cooperating runs and the several streams of one
+ run each take their own.  RNG_LEGACY is the generator of the original
+ program, 16807*seed mod 2^31-1 computed in double arithmetic; it gives
+ the results of earlier versions for the same seeds.  It has no jumps:
+ its streams are derived from the seed by multiplication, as before. */
+
+#include <stdint.h>
+#include <math.h>
+
+#define RNG_LEGACY                   0  /* Park-Miller in doubles           */
+#define RNG_XOSHIRO                  1  /* xoshiro256**                     */
+#define RNG_DEFAULT        RNG_XOSHIRO
+
+#define RNG_LEGACY_MOD      2147483647.
+
+typedef struct
+     {int kind;           /* RNG_LEGACY or RNG_XOSHIRO                        */
+      double seed;        /* RNG_LEGACY: state                                */
+      uint64_t s[4];      /* RNG_XOSHIRO: state                               */
+     }Rng;
+
+void rng_seed(Rng *pr, int kind, double seed);
+void rng_jump(Rng *pr);
+void rng_stream(const Rng *master, int stream, Rng *pr);
+
+static inline uint64_t rng_rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+/* Returns a number uniformly distributed in [0,1). */
+static inline double rng_next(Rng *pr) {
+	double rd, rf;
+	uint64_t r, t;
+	uint64_t *s = pr->s;
+
+	if (pr->kind == RNG_LEGACY) {
+		rd = 16807 * pr->seed;
+		rf = floor(rd / RNG_LEGACY_MOD);
+		pr->seed = rd - rf * RNG_LEGACY_MOD;
+		return pr->seed / (RNG_LEGACY_MOD + 1);
+	}
+	r = rng_rotl(*(s + 1) * 5, 7) * 9;
+	t = *(s + 1) << 17;
+	*(s + 2) ^= *s;
+	*(s + 3) ^= *(s + 1);
+	*(s + 1) ^= *(s + 2);
+	*s ^= *(s + 3);
+	*(s + 2) ^= t;
+	*(s + 3) = rng_rotl(*(s + 3), 45);
+	return (r >> 11) * 0x1.0p-53;
+}
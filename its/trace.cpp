@@ -0,0 +1,73 @@
+/* Convergence trace of ITS runs, see 'trace.h'. */
+
+#include <stdlib.h>
+#include "ITS.h"
+
+/* Returns ITS_OK, or ITS_ERR_MEMORY leaving tracing off. */
+int trace_alloc(int size, Trace *ptr) {
+	ptr->points = NULL;
+	ptr->size = 0;
+	trace_clear(ptr);
+	if (size > 0) {
+		ALR(ptr->points, TracePoint, size)
+		ptr->size = size;
+	}
+	return ITS_OK;
+}
+
+/* Empties the ring for another run. */
+void trace_clear(Trace *ptr) {
+	ptr->first = ptr->count = 0;
+	ptr->dropped = 0;
+}
+
+void trace_free(Trace *ptr) {
+	free(ptr->points);
+	ptr->points = NULL;
+	ptr->size = ptr->count = 0;
+}
+
+static int trace_compare(const void *a, const void *b) {
+	const TracePoint *pa = (const TracePoint *) a;
+	const TracePoint *pb = (const TracePoint *) b;
+
+	if (pa->us != pb->us)
+		return pa->us < pb->us ? -1 : 1;
+	return pa->value > pb->value ? -1 : pa->value < pb->value;
+}
+
+/* Writes to merged the points of count traces, in time order, that
+ improve the best value of all of them; returns their number. merged
+ must have room for all the points of the traces. */
+int trace_merge(const Trace *traces, int count, TracePoint *merged) {
+	const Trace *ptr;
+	int i, t, n = 0, kept = 0;
+
+	for (t = 0; t < count; t++) {
+		ptr = traces + t;
+		for (i = 0; i < ptr->count; i++)
+			*(merged + n++) = *(ptr->points + (ptr->first + i) % ptr->size);
+	}
+	qsort(merged, n, sizeof(TracePoint), trace_compare);
+	for (i = 0; i < n; i++)
+		if (kept == 0
+				|| (merged + i)->value > (merged + kept - 1)->value + 0.00001)
+			*(merged + kept++) = *(merged + i);
+	return kept;
+}
+
+/* Writes points as CSV lines "us,iteration,start,value"; returns 0 on
+ success. */
+int trace_write(const char *file_name, const TracePoint *points, int count) {
+	FILE *f;
+	int i;
+
+	if ((f = fopen(file_name, "w")) == NULL)
+		return -1;
+	fprintf(f, "us,iteration,start,value\n");
+	for (i = 0; i < count; i++)
+		fprintf(f, "%.0lf,%ld,%d,%.6lf\n", (points + i)->us,
+				(points + i)->iteration, (points + i)->start,
+				(points + i)->value);
+	return fclose(f) == 0 ? 0 : -1;
+}
@@ -0,0 +1,53 @@
+/* Convergence trace of ITS runs.
+ A run records a TracePoint whenever its best value improves: the time
+ since the start of the run in microseconds, the tabu search iteration,
+ the start (restart) number and the new best value.  The points go to a
+ ring allocated before the run, so recording costs no allocation and no
+ output in the search; when the ring is full the oldest points are
+ overwritten (and counted in dropped), keeping the end of the curve.
+ trace_merge() combines the traces of cooperating runs into the best
+ value of all of them over time. */
+
+#include <stdio.h>
+
+#define TRACE_SIZE_DEFAULT        4096  /* points kept per run              */
+
+typedef struct
+     {double us;          /* microseconds from the start of the run           */
+      long iteration;     /* tabu search iterations done                      */
+      int start;          /* start no.                                        */
+      double value;       /* best value from this moment on                   */
+     }TracePoint;
+
+typedef struct
+     {TracePoint *points; /* ring of size entries, NULL if tracing is off     */
+      int size;           /* capacity of the ring, 0 - off                    */
+      int first;          /* position of the oldest point                     */
+      int count;          /* points in the ring                               */
+      long dropped;       /* points overwritten                               */
+     }Trace;
+
+int trace_alloc(int size, Trace *ptr);
+void trace_clear(Trace *ptr);
+void trace_free(Trace *ptr);
+int trace_merge(const Trace *traces, int count, TracePoint *merged);
+int trace_write(const char *file_name, const TracePoint *points, int count);
+
+static inline void trace_add(Trace *ptr, double us, long iteration, int start,
+		double value) {
+	TracePoint *pp;
+
+	if (ptr->size == 0)
+		return;
+	if (ptr->count == ptr->size) {
+		ptr->first = (ptr->first + 1) % ptr->size;
+		(ptr->count)--;
+		(ptr->dropped)++;
+	}
+	pp = ptr->points + (ptr->first + ptr->count) % ptr->size;
+	pp->us = us;
+	pp->iteration = iteration;
+	pp->start = start;
+	pp->value = value;
+	(ptr->count)++;
+}
@@ -0,0 +1,748 @@
+/* Solver daemon: keeps loaded instances in memory and solves requests
+ sent as JSON lines, read from stdin (answers go to stdout) or from the
+ connections of a Unix socket (answers go back on the connection).
+ A request is an object with the members
+   "instance"         path of the instance file, required;
+   "storage"          "dense" (default), "float", "double", "sparse" or
+                      "points", as its -s;
+   "b1", "b2"         bounds on the subgraph's size, default 30;
+   "seed"             default 1000;
+   "time_ms"          time limit, default 1000;
+   "iterations"       limit on tabu search iterations, default none;
+   "target"           target value, default none;
+   "iterations_coef"  default 1000;
+   "runs"             cooperating runs (ITS_coop), default 1;
+   "scan_threads"     threads splitting the scans of each run, at most
+                      the number of processors, default 1;
+   "swap_cand"        length of the swap candidate lists, at most the
+                      graph order, default 0 (off);
+   "rng_kind"         "xoshiro" (default) or "legacy", as its -r;
+   "trace_size"       points of the convergence trace of each run,
+                      written to the report, default 0 (off);
+   "output"           name of a file in the output directory (-o) for
+                      the report of ITS, default none; rejected
+                      without -o, and a name with a '/' in it always;
+   "id"               any JSON value, copied to the answer.
+ The answer is one line, either
+   {"id": ..., "status": "ok", "value": v, "size": s, "starts": n,
+    "time_to_opt": t, "total_time": t, "solution": [vertices]}
+ with the vertices 0-based as in the instance file, times in seconds,
+ or {"id": ..., "status": "error", "error": "..."}. Answers come in the
+ order in which the solves end, which with several workers need not be
+ the order of the requests.
+ Instances are cached by path and storage, at most CACHE_ENTRIES of them
+ (-c); the least recently used one that is not being solved is dropped
+ first. The file is looked at (stat) for every request, and an instance
+ whose file has a new modification time or size is loaded again. All
+ solves of one instance share the loaded copy, which is only read.
+ Each worker solves with a Solver of its own (ITS_solve()), whose
+ buffers serve all its requests on instances of the same order; a file
+ that cannot be loaded or a solve that fails gets an error answer.
+ A socket left at socket_path by an earlier run is replaced; any other
+ file there makes itsd stop.
+ Usage: itsd [-j workers] [-c cache_entries] [-u socket_path]
+             [-o output_dir] */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "ITS.h"
+
+#define CACHE_ENTRIES                8  /* default instances kept loaded    */
+#define REQUEST_MAX_VALUE         4096  /* longest value of a request       */
+
+/* Where the answers to the requests of one client go. */
+typedef struct
+     {int fd;             /* written with write(2)                            */
+      pthread_mutex_t lock;
+      int refs;           /* reader and unanswered requests; closed at 0      */
+      int owned;          /* 1 if fd is to be closed at the end               */
+     }Client;
+
+typedef struct
+     {char instance[PATH_MAX];
+      char output[PATH_MAX];
+      char id[REQUEST_MAX_VALUE];  /* JSON text of "id", or empty             */
+      int storage;
+      int b1, b2;
+      int runs;
+      int scan_threads;
+      int swap_cand;
+      int rng_kind;
+      int trace_size;
+      double seed;
+      long iterations_coef;
+      Limits limits;
+     }Request;
+
+typedef struct Job
+     {Request req;
+      Client *client;
+      struct Job *next;
+     }Job;
+
+typedef struct CacheEntry
+     {char path[PATH_MAX];
+      int storage;
+      struct timespec mtime;      /* of the file when it was loaded          */
+      off_t bytes;                /* size of the file when it was loaded     */
+      Weights weights;
+      int status;                 /* of ITS_load(); not ITS_OK - no weights  */
+      int ready;                  /* 0 while being loaded                    */
+      int stale;                  /* 1 once the file has changed             */
+      int refs;                   /* solves using the instance               */
+      long used;                  /* cache clock at the last request         */
+      struct CacheEntry *next;
+     }CacheEntry;
+
+static const char *output_dir = NULL;  /* -o; NULL - no output files     */
+
+static struct
+     {pthread_mutex_t lock;
+      pthread_cond_t loaded;      /* signalled when an instance is ready     */
+      CacheEntry *first;
+      int capacity;
+      long clock;
+     }cache = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL,
+		CACHE_ENTRIES, 0 };
+
+static struct
+     {pthread_mutex_t lock;
+      pthread_cond_t posted;
+      Job *first, *last;
+      int closed;                 /* 1 when no more jobs will be posted      */
+     }queue = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL,
+		NULL, 0 };
+
+static void client_release(Client *pc) {
+	int refs;
+
+	pthread_mutex_lock(&pc->lock);
+	refs = --(pc->refs);
+	pthread_mutex_unlock(&pc->lock);
+	if (refs > 0)
+		return;
+	if (pc->owned)
+		close(pc->fd);
+	pthread_mutex_destroy(&pc->lock);
+	free(pc);
+}
+
+/* Writes one answer line; a client that went away is ignored. */
+static void client_write(Client *pc, const char *text, size_t length) {
+	ssize_t n;
+
+	pthread_mutex_lock(&pc->lock);
+	while (length > 0 && (n = write(pc->fd, text, length)) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		text += n;
+		length -= n;
+	}
+	pthread_mutex_unlock(&pc->lock);
+}
+
+static void answer_error(Client *pc, const char *id, const char *error) {
+	char line[2 * REQUEST_MAX_VALUE];
+	int n;
+
+	n = snprintf(line, sizeof(line),
+			"{\"id\": %s, \"status\": \"error\", \"error\": \"%s\"}\n",
+			*id != '\0' ? id : "null", error);
+	client_write(pc, line, n < (int) sizeof(line) ? n : sizeof(line) - 1);
+}
+
+static const char *json_blanks(const char *p) {
+	while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+		p++;
+	return p;
+}
+
+/* Parses a JSON string into buf (the escapes \uXXXX are only accepted
+ for ASCII); returns the position after it or NULL. */
+static const char *json_string(const char *p, char *buf, int size) {
+	int n = 0;
+	unsigned u;
+	char c;
+
+	if (*p++ != '"')
+		return NULL;
+	while ((c = *p++) != '"') {
+		if (c == '\0' || n >= size - 1)
+			return NULL;
+		if (c == '\\') {
+			switch (c = *p++) {
+			case 'n':
+				c = '\n';
+				break;
+			case 't':
+				c = '\t';
+				break;
+			case 'r':
+				c = '\r';
+				break;
+			case 'b':
+				c = '\b';
+				break;
+			case 'f':
+				c = '\f';
+				break;
+			case 'u':
+				if (sscanf(p, "%4x", &u) != 1 || u == 0 || u > 0x7f)
+					return NULL;
+				c = (char) u;
+				p += 4;
+				break;
+			case '"':
+			case '\\':
+			case '/':
+				break;
+			default:
+				return NULL;
+			}
+		}
+		*(buf + n++) = c;
+	}
+	*(buf + n) = '\0';
+	return p;
+}
+
+/* Skips a JSON value other than a string (a number, true, false or
+ null), copying its text into buf; returns the position after it or
+ NULL. */
+static const char *json_scalar(const char *p, char *buf, int size) {
+	int n = 0;
+
+	while (*p != '\0' && *p != ',' && *p != '}' && *p != ' ' && *p != '\t'
+			&& *p != '\r' && *p != '\n') {
+		if (n >= size - 1)
+			return NULL;
+		*(buf + n++) = *p++;
+	}
+	*(buf + n) = '\0';
+	return n > 0 ? p : NULL;
+}
+
+static int parse_storage(const char *name) {
+	if (strcmp(name, "dense") == 0)
+		return WEIGHTS_DENSE;
+	if (strcmp(name, "float") == 0)
+		return WEIGHTS_PACKED_FLOAT;
+	if (strcmp(name, "double") == 0)
+		return WEIGHTS_PACKED_DOUBLE;
+	if (strcmp(name, "sparse") == 0)
+		return WEIGHTS_SPARSE;
+	if (strcmp(name, "points") == 0)
+		return WEIGHTS_POINTS;
+	return -1;
+}
+
+/* Parses one request line, a flat JSON object; returns NULL or the
+ reason it is rejected. The "id" is kept as far as it was read. */
+static const char *parse_request(const char *p, Request *pr) {
+	char key[64], value[REQUEST_MAX_VALUE];
+	const char *start;
+	int is_string;
+
+	memset(pr, 0, sizeof(Request));
+	pr->storage = WEIGHTS_DENSE;
+	pr->b1 = pr->b2 = 30;
+	pr->runs = 1;
+	pr->scan_threads = 1;
+	pr->swap_cand = 0;
+	pr->rng_kind = RNG_DEFAULT;
+	pr->trace_size = 0;
+	pr->seed = 1000.;
+	pr->iterations_coef = 1000;
+	pr->limits.time_ms = 1000.;
+	p = json_blanks(p);
+	if (*p++ != '{')
+		return "request is not a JSON object";
+	p = json_blanks(p);
+	if (*p == '}')
+		p++;
+	else
+		for (;;) {
+			if ((p = json_string(json_blanks(p), key, sizeof(key))) == NULL)
+				return "malformed request";
+			p = json_blanks(p);
+			if (*p++ != ':')
+				return "malformed request";
+			start = p = json_blanks(p);
+			is_string = *p == '"';
+			if (is_string)
+				p = json_string(p, value, sizeof(value));
+			else
+				p = json_scalar(p, value, sizeof(value));
+			if (p == NULL)
+				return "malformed request";
+			if (strcmp(key, "id") == 0) {
+				if (p - start >= (long) sizeof(pr->id))
+					return "id too long";
+				memcpy(pr->id, start, p - start);
+				*(pr->id + (p - start)) = '\0';
+			} else if (strcmp(key, "instance") == 0 && is_string)
+				snprintf(pr->instance, sizeof(pr->instance), "%s", value);
+			else if (strcmp(key, "output") == 0 && is_string) {
+				if (output_dir == NULL)
+					return "output files are not enabled";
+				if (value[0] == '\0' || strchr(value, '/') != NULL
+						|| strcmp(value, ".") == 0 || strcmp(value, "..") == 0)
+					return "invalid output file name";
+				if (snprintf(pr->output, sizeof(pr->output), "%s/%s",
+						output_dir, value) >= (int) sizeof(pr->output))
+					return "output path too long";
+			}
+			else if (strcmp(key, "storage") == 0 && is_string) {
+				if ((pr->storage = parse_storage(value)) < 0)
+					return "unknown storage";
+			} else if (strcmp(key, "rng_kind") == 0 && is_string) {
+				if (strcmp(value, "xoshiro") == 0)
+					pr->rng_kind = RNG_XOSHIRO;
+				else if (strcmp(value, "legacy") == 0)
+					pr->rng_kind = RNG_LEGACY;
+				else
+					return "unknown rng_kind";
+			} else if (is_string)
+				return "unexpected string member";
+			else if (strcmp(key, "b1") == 0)
+				pr->b1 = atoi(value);
+			else if (strcmp(key, "b2") == 0)
+				pr->b2 = atoi(value);
+			else if (strcmp(key, "seed") == 0)
+				pr->seed = atof(value);
+			else if (strcmp(key, "time_ms") == 0)
+				pr->limits.time_ms = atof(value);
+			else if (strcmp(key, "iterations") == 0)
+				pr->limits.iterations = atol(value);
+			else if (strcmp(key, "target") == 0) {
+				pr->limits.target = atof(value);
+				pr->limits.has_target = 1;
+			} else if (strcmp(key, "iterations_coef") == 0)
+				pr->iterations_coef = atol(value);
+			else if (strcmp(key, "runs") == 0)
+				pr->runs = atoi(value);
+			else if (strcmp(key, "scan_threads") == 0)
+				pr->scan_threads = atoi(value);
+			else if (strcmp(key, "swap_cand") == 0)
+				pr->swap_cand = atoi(value);
+			else if (strcmp(key, "trace_size") == 0)
+				pr->trace_size = atoi(value);
+			else
+				return "unknown member";
+			p = json_blanks(p);
+			if (*p == '}') {
+				p++;
+				break;
+			}
+			if (*p++ != ',')
+				return "malformed request";
+		}
+	if (*json_blanks(p) != '\0')
+		return "trailing characters after the request";
+	if (pr->instance[0] == '\0')
+		return "no instance";
+	if (pr->b1 < 1 || pr->b2 < pr->b1)
+		return "invalid bounds b1, b2";
+	if (pr->runs < 1)
+		return "invalid number of runs";
+	if (pr->scan_threads < 1
+			|| pr->scan_threads > sysconf(_SC_NPROCESSORS_ONLN))
+		return "invalid number of scan threads";
+	if (pr->swap_cand < 0)
+		return "invalid swap_cand";
+	if (pr->trace_size < 0)
+		return "invalid trace_size";
+	if (pr->limits.time_ms <= 0. && pr->limits.iterations <= 0
+			&& !pr->limits.has_target)
+		return "no limit on the solve";
+	return NULL;
+}
+
+static void free_entry(CacheEntry *pe) {
+	if (pe->status == ITS_OK)
+		free_weights(&pe->weights);
+	free(pe);
+}
+
+/* Drops least recently used instances not in use until at most
+ cache.capacity are cached. Called with cache.lock held. */
+static void cache_trim(void) {
+	CacheEntry *pe, **pp, **lru;
+	int count = 0;
+
+	for (pe = cache.first; pe != NULL; pe = pe->next)
+		count++;
+	while (count > cache.capacity) {
+		lru = NULL;
+		for (pp = &cache.first; *pp != NULL; pp = &(*pp)->next)
+			if ((*pp)->ready && (*pp)->refs == 0
+					&& (lru == NULL || (*pp)->used < (*lru)->used))
+				lru = pp;
+		if (lru == NULL)
+			return;
+		pe = *lru;
+		*lru = pe->next;
+		free_entry(pe);
+		count--;
+	}
+}
+
+/* Returns the instance of path in the given storage, loaded if it is
+ not cached or its file changed, or NULL if the file cannot be read.
+ A failed load leaves its status in the entry, which is then stale.
+ To be given back with cache_release(). */
+static CacheEntry *cache_acquire(const char *path, int storage) {
+	CacheEntry *pe, **pp;
+	struct stat st;
+
+	if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+		return NULL;
+	pthread_mutex_lock(&cache.lock);
+	for (pp = &cache.first; *pp != NULL; pp = &(*pp)->next) {
+		pe = *pp;
+		if (pe->stale || pe->storage != storage || strcmp(pe->path, path) != 0)
+			continue;
+		if (pe->mtime.tv_sec != st.st_mtim.tv_sec
+				|| pe->mtime.tv_nsec != st.st_mtim.tv_nsec
+				|| pe->bytes != st.st_size) {
+			/* the file changed: forget this copy once no solve uses it */
+			pe->stale = 1;
+			if (pe->refs == 0 && pe->ready) {
+				*pp = pe->next;
+				free_entry(pe);
+			}
+			break;
+		}
+		(pe->refs)++;
+		pe->used = ++cache.clock;
+		while (!pe->ready)
+			pthread_cond_wait(&cache.loaded, &cache.lock);
+		pthread_mutex_unlock(&cache.lock);
+		return pe;
+	}
+	if ((pe = (CacheEntry *) calloc(1, sizeof(CacheEntry))) == NULL) {
+		pthread_mutex_unlock(&cache.lock);
+		return NULL;
+	}
+	snprintf(pe->path, sizeof(pe->path), "%s", path);
+	pe->storage = storage;
+	pe->mtime = st.st_mtim;
+	pe->bytes = st.st_size;
+	pe->refs = 1;
+	pe->used = ++cache.clock;
+	pe->next = cache.first;
+	cache.first = pe;
+	pthread_mutex_unlock(&cache.lock);
+	/* load without the lock, so that cached instances can be served */
+	pe->status = ITS_load(pe->path, storage, sysconf(_SC_NPROCESSORS_ONLN),
+			&pe->weights);
+	pthread_mutex_lock(&cache.lock);
+	if (pe->status != ITS_OK)
+		pe->stale = 1;
+	pe->ready = 1;
+	pthread_cond_broadcast(&cache.loaded);
+	cache_trim();
+	pthread_mutex_unlock(&cache.lock);
+	return pe;
+}
+
+static void cache_release(CacheEntry *pe) {
+	CacheEntry **pp;
+
+	pthread_mutex_lock(&cache.lock);
+	(pe->refs)--;
+	if (pe->stale && pe->refs == 0) {
+		for (pp = &cache.first; *pp != pe; pp = &(*pp)->next)
+			;
+		*pp = pe->next;
+		free_entry(pe);
+	} else
+		cache_trim();
+	pthread_mutex_unlock(&cache.lock);
+}
+
+/* Solves the request of job with the solver *ps of the worker, into *pres;
+ both keep their buffers for the next request. */
+static void solve(Job *job, Solver *ps, Results *pres) {
+	Request *pr = &job->req;
+	CacheEntry *pe;
+	Params params;
+	FILE *f;
+	char *text = NULL;
+	size_t length = 0;
+	int i, status, first = 1;
+
+	if ((pe = cache_acquire(pr->instance, pr->storage)) == NULL) {
+		answer_error(job->client, pr->id, "cannot read the instance");
+		return;
+	}
+	if ((status = pe->status) != ITS_OK) {
+		cache_release(pe);
+		answer_error(job->client, pr->id, ITS_error(status));
+		return;
+	}
+	if (pr->b2 > pe->weights.size) {
+		cache_release(pe);
+		answer_error(job->client, pr->id, "b2 exceeds the graph order");
+		return;
+	}
+	if (pr->swap_cand > pe->weights.size) {
+		cache_release(pe);
+		answer_error(job->client, pr->id,
+				"swap_cand exceeds the graph order");
+		return;
+	}
+	params.b1 = pr->b1;
+	params.b2 = pr->b2;
+	params.seed = pr->seed;
+	params.iterations_coef = pr->iterations_coef;
+	params.limits = pr->limits;
+	params.workers = pr->runs;
+	params.scan_threads = pr->scan_threads;
+	params.swap_cand = pr->swap_cand;
+	params.rng_kind = pr->rng_kind;
+	params.trace_size = pr->trace_size;
+	status = ITS_solve(&pe->weights, &params, ps, pres);
+	if (status == ITS_OK && pr->output[0] != '\0'
+			&& ITS_report(pr->output, &pe->weights, &params, ps, pres)
+					!= ITS_OK) {
+		cache_release(pe);
+		answer_error(job->client, pr->id, "cannot write the output file");
+		return;
+	}
+	cache_release(pe);
+	if (status != ITS_OK) {
+		answer_error(job->client, pr->id, ITS_error(status));
+		return;
+	}
+	if ((f = open_memstream(&text, &length)) == NULL) {
+		answer_error(job->client, pr->id, "out of memory");
+		return;
+	}
+	fprintf(f, "{\"id\": %s, \"status\": \"ok\", \"value\": %.3lf, "
+			"\"size\": %ld, \"starts\": %ld, \"time_to_opt\": %.6lf, "
+			"\"total_time\": %.6lf, \"solution\": [",
+			pr->id[0] != '\0' ? pr->id : "null", pres->value,
+			pres->characts[7], pres->characts[2], pres->time_to_opt,
+			pres->total_time);
+	for (i = 1; i <= pres->characts[0]; i++)
+		if (*(pres->sol + i) == 1) {
+			fprintf(f, first ? "%d" : ", %d", i - 1);
+			first = 0;
+		}
+	fprintf(f, "]}\n");
+	fclose(f);
+	client_write(job->client, text, length);
+	free(text);
+}
+
+static void *worker(void *arg) {
+	Job *job;
+	Solver solver;
+	Results res;
+
+	ITS_solver_init(&solver);
+	memset(&res, 0, sizeof(res));
+	for (;;) {
+		pthread_mutex_lock(&queue.lock);
+		while (queue.first == NULL && !queue.closed)
+			pthread_cond_wait(&queue.posted, &queue.lock);
+		if ((job = queue.first) == NULL) {
+			pthread_mutex_unlock(&queue.lock);
+			break;
+		}
+		if ((queue.first = job->next) == NULL)
+			queue.last = NULL;
+		pthread_mutex_unlock(&queue.lock);
+		solve(job, &solver, &res);
+		client_release(job->client);
+		free(job);
+	}
+	ITS_solver_free(&solver);
+	free(res.sol);
+	free(res.trace);
+	return NULL;
+}
+
+/* Reads the requests of a client line by line and queues them. */
+static void read_requests(FILE *in, Client *pc) {
+	Job *job;
+	Request req;
+	const char *error;
+	char *line = NULL;
+	size_t size = 0;
+
+	while (getline(&line, &size, in) > 0) {
+		if (*json_blanks(line) == '\0')
+			continue;
+		if ((error = parse_request(line, &req)) != NULL) {
+			answer_error(pc, req.id, error);
+			continue;
+		}
+		if ((job = (Job *) calloc(1, sizeof(Job))) == NULL) {
+			answer_error(pc, req.id, "out of memory");
+			continue;
+		}
+		job->req = req;
+		job->client = pc;
+		pthread_mutex_lock(&pc->lock);
+		(pc->refs)++;
+		pthread_mutex_unlock(&pc->lock);
+		pthread_mutex_lock(&queue.lock);
+		if (queue.last != NULL)
+			queue.last->next = job;
+		else
+			queue.first = job;
+		queue.last = job;
+		pthread_cond_signal(&queue.posted);
+		pthread_mutex_unlock(&queue.lock);
+	}
+	free(line);
+}
+
+static Client *client_new(int fd, int owned) {
+	Client *pc;
+
+	if ((pc = (Client *) calloc(1, sizeof(Client))) == NULL)
+		return NULL;
+	pc->fd = fd;
+	pc->owned = owned;
+	pc->refs = 1;
+	pthread_mutex_init(&pc->lock, NULL);
+	return pc;
+}
+
+static void *connection(void *arg) {
+	Client *pc = (Client *) arg;
+	FILE *in;
+	int fd;
+
+	if ((fd = dup(pc->fd)) >= 0 && (in = fdopen(fd, "r")) != NULL) {
+		read_requests(in, pc);
+		fclose(in);
+	} else if (fd >= 0)
+		close(fd);
+	client_release(pc);
+	return NULL;
+}
+
+static void serve_socket(const char *path) {
+	struct sockaddr_un addr;
+	pthread_t tid;
+	Client *pc;
+	struct stat st;
+	int s, fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("  socket path too long  %s\n", path);
+		exit(1);
+	}
+	strcpy(addr.sun_path, path);
+	/* replace the socket of an earlier run, but nothing else */
+	if (lstat(path, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			printf("  %s exists and is not a socket\n", path);
+			exit(1);
+		}
+		unlink(path);
+	}
+	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+			|| bind(s, (struct sockaddr *) &addr, sizeof(addr)) != 0
+			|| listen(s, SOMAXCONN) != 0) {
+		printf("  cannot listen on %s\n", path);
+		exit(1);
+	}
+	for (;;) {
+		if ((fd = accept(s, NULL, NULL)) < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			printf("  accept failed\n");
+			exit(1);
+		}
+		if ((pc = client_new(fd, 1)) == NULL) {
+			close(fd);
+			continue;
+		}
+		if (pthread_create(&tid, NULL, connection, pc) != 0) {
+			client_release(pc);
+			continue;
+		}
+		pthread_detach(tid);
+	}
+}
+
+int main(int argc, char **argv) {
+	pthread_t *tids;
+	Client *pc;
+	const char *socket_path = NULL;
+	struct stat st;
+	int workers = sysconf(_SC_NPROCESSORS_ONLN);
+	int c, w;
+
+	while ((c = getopt(argc, argv, "j:c:u:o:")) != -1) {
+		switch (c) {
+		case 'j':
+			workers = atoi(optarg);
+			break;
+		case 'c':
+			cache.capacity = atoi(optarg);
+			break;
+		case 'u':
+			socket_path = optarg;
+			break;
+		case 'o':
+			output_dir = optarg;
+			break;
+		default:
+			printf("  usage: itsd [-j workers] [-c cache_entries] "
+					"[-u socket_path] [-o output_dir]\n");
+			exit(1);
+		}
+	}
+	if (output_dir != NULL
+			&& (stat(output_dir, &st) != 0 || !S_ISDIR(st.st_mode))) {
+		printf("  no output directory %s\n", output_dir);
+		exit(1);
+	}
+	if (workers < 1)
+		workers = 1;
+	if (cache.capacity < 1)
+		cache.capacity = 1;
+	signal(SIGPIPE, SIG_IGN);
+	if ((tids = (pthread_t *) calloc(workers, sizeof(pthread_t))) == NULL)
+		exit(1);
+	for (w = 0; w < workers; w++)
+		if (pthread_create(tids + w, NULL, worker, NULL) != 0) {
+			printf("  pthread_create failed\n");
+			exit(1);
+		}
+	if (socket_path != NULL)
+		serve_socket(socket_path);
+	/* stdin: answer the requests, then stop once all are answered */
+	if ((pc = client_new(1, 0)) == NULL)
+		exit(1);
+	read_requests(stdin, pc);
+	pthread_mutex_lock(&queue.lock);
+	queue.closed = 1;
+	pthread_cond_broadcast(&queue.posted);
+	pthread_mutex_unlock(&queue.lock);
+	for (w = 0; w < workers; w++)
+		pthread_join(*(tids + w), NULL);
+	client_release(pc);
+	free(tids);
+	return 0;
+}
@@ -0,0 +1,79 @@
+/* Converts an instance in the triplet text format into the binary format
+ of 'loader.h', which its and rmcrag map without parsing.
+ Usage: mdp2bin [-s dense|float|double] input_file output_file
+ The storage kind chosen is the one ITS will use for the instance. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ITS.h"
+
+int main(int argc, char **argv) {
+	Weights weights;
+	Weights *pweight = &weights;
+	BinaryHeader header;
+	TripletFile file;
+	int storage = WEIGHTS_DENSE;
+	int c, status;
+	long e_count;
+
+	while ((c = getopt(argc, argv, "s:")) != -1) {
+		switch (c) {
+		case 's':
+			if (strcmp(optarg, "dense") == 0)
+				storage = WEIGHTS_DENSE;
+			else if (strcmp(optarg, "float") == 0)
+				storage = WEIGHTS_PACKED_FLOAT;
+			else if (strcmp(optarg, "double") == 0)
+				storage = WEIGHTS_PACKED_DOUBLE;
+			else {
+				printf("  unknown storage %s (dense, float or double)\n",
+						optarg);
+				exit(1);
+			}
+			break;
+		default:
+			exit(1);
+		}
+	}
+	if (argc - optind < 2) {
+		printf("  usage: mdp2bin [-s dense|float|double] input output\n");
+		exit(1);
+	}
+	if (triplets_open(argv[optind], &file) != 0) {
+		printf("  fopen failed for input\n");
+		exit(1);
+	}
+	header.second = file.second;
+	triplets_close(&file);
+	status = ITS_load(argv[optind], storage, sysconf(_SC_NPROCESSORS_ONLN),
+			pweight);
+	if (status != ITS_OK) {
+		printf("  %s: %s\n", ITS_error(status), argv[optind]);
+		exit(1);
+	}
+	if (pweight->file.map != NULL) {
+		printf("  %s is a binary instance already\n", argv[optind]);
+		exit(1);
+	}
+	e_count = ((long) pweight->size) * (pweight->size - 1) / 2;
+	header.size = pweight->size;
+	header.kind = pweight->kind;
+	header.stride = pweight->stride;
+	if (pweight->kind == WEIGHTS_DENSE)
+		header.bytes = (pweight->size + 1) * pweight->stride * sizeof(double);
+	else if (pweight->kind == WEIGHTS_PACKED_FLOAT)
+		header.bytes = e_count * sizeof(float);
+	else
+		header.bytes = e_count * sizeof(double);
+	if (binary_write(argv[optind + 1], &header,
+			pweight->kind == WEIGHTS_PACKED_FLOAT ?
+					(const void *) pweight->wf : (const void *) pweight->w)
+			!= 0) {
+		printf("  failed to write %s\n", argv[optind + 1]);
+		exit(1);
+	}
+	free_weights(pweight);
+	return 0;
+}
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <functional>
 #include <queue>
 #include <set>
@@ -11,6 +12,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <ctime>
+#include "loader.h"
 
 using namespace std;
 
@@ -220,42 +222,105 @@ Element* rmcrag(const std::set<int> clusterings, const double **pweight, int p,
 
 #define weight(X,Y) *(*(pweight+X)+Y)
 
+static void put_triplet(void *ctx, int i, int j, double w) {
+	double **pweight = (double **) ctx;
+	weight(i,j) = w;
+	weight(j,i) = w;
+}
+
+/* Makes the matrix of a binary instance. Dense weights are used in
+ place, with row pointers into the mapped file (which stays mapped);
+ packed ones are expanded. */
+double** load_binary(BinaryFile *file, unsigned int* p) {
+   	FILE  *out = stdout;
+	double **pweight;
+	double *w;
+	float *wf;
+	unsigned int i, j;
+	long k;
+	unsigned int size = file->header.size;
+	long e_count = ((long) size) * (size - 1) / 2;
+	long bytes;
+
+	*p = size;
+	if (file->header.kind == WEIGHTS_DENSE)
+		bytes = (size + 1) * file->header.stride * sizeof(double);
+	else if (file->header.kind == WEIGHTS_PACKED_FLOAT)
+		bytes = e_count * sizeof(float);
+	else if (file->header.kind == WEIGHTS_PACKED_DOUBLE)
+		bytes = e_count * sizeof(double);
+	else
+		bytes = -1;
+	if (bytes != file->header.bytes || (file->header.kind == WEIGHTS_DENSE
+			&& (file->header.stride <= size || file->header.stride
+					% (WEIGHT_ALIGN / sizeof(double)) != 0))) {
+		printf("  invalid binary input file\n");
+		exit(1);
+	}
+
+	ALMF(pweight, size)
+
+	if (file->header.kind == WEIGHTS_DENSE) {
+		w = (double *) file->payload;
+		for (k = 0; k < size; k++)
+			*(pweight+k) = w + (k + 1) * file->header.stride + 1;
+		return pweight;
+	}
+	for (k = 0; k < size; k++)
+		ALF(*(pweight+k), size)
+	w = (double *) file->payload;
+	wf = (float *) file->payload;
+	for (i = 0, k = 0; i < size; i++)
+		for (j = i + 1; j < size; j++, k++) {
+			weight(i,j) = file->header.kind == WEIGHTS_PACKED_FLOAT ?
+					*(wf + k) : *(w + k);
+			weight(j,i) = weight(i,j);
+		}
+	binary_close(file);
+	return pweight;
+}
+
 double** load_matrix(const char *in_file_name, unsigned int* p) {
-   	FILE  *in;
    	FILE  *out = NULL;
+	TripletFile file;
+	BinaryFile binary;
 	double **pweight;
-	int i, j,lo,k;
-	double w;
-	long e_count;
+	int k;
 	unsigned int size = 0;
 
-   	if ((in = fopen(in_file_name, "r")) == NULL) {
+	k = binary_open(in_file_name, &binary);
+	if (k < 0) {
+		printf("  invalid binary input file\n");
+		exit(1);
+	}
+	if (k == 0)
+		return load_binary(&binary, p);
+	if (triplets_open(in_file_name, &file) != 0) {
 		printf("  fopen failed for input\n");
 		exit(1);
 	}
-	fscanf(in, "%d %d", &size,&i);
+	size = file.size;
 
 	*p = size;
 
-	e_count = ((long) size) * (size - 1) / 2;
-	
 	ALMF(pweight, size)
 
 	for (k = 0; k < size; k++)
 		ALF(*(pweight+k), size)
-	
-	for (lo = 0; lo < e_count; lo++) {
-		fscanf(in, "%d %d %lf\n", &i, &j, &w);
-		weight(i,j) = w;
-		weight(j,i) = w;
+
+	if (triplets_read(&file, sysconf(_SC_NPROCESSORS_ONLN), put_triplet,
+			pweight) < 0) {
+		printf("  malformed input file %s\n", in_file_name);
+		exit(1);
 	}
+	triplets_close(&file);
 	return pweight;
 }
 
 int main(int argc, char **argv) {
 
-	time_t tstart, tend; 
-	tstart = time(0);
+	std::chrono::steady_clock::time_point tstart, tend;
+	tstart = std::chrono::steady_clock::now();
 
 	char* in_file_name;
 
@@ -319,9 +384,10 @@ int main(int argc, char **argv) {
 	}
 	std::cout << std::endl;
 
-	tend = time(0); 
+	tend = std::chrono::steady_clock::now();
 
-	cout << "RMCRAG took "<< difftime(tend, tstart) << " second(s)."<< endl;
+	cout << "RMCRAG took "<< std::chrono::duration<double>(tend - tstart).count()
+		<< " second(s)."<< endl;
 
 	cout << "Cost of solution (AVG): " << elementWithTopClusterings->cost << endl;
 